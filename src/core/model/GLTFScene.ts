@@ -0,0 +1,402 @@
+import { Matrix4 } from '../../math/Matrix4';
+import { Quaternion } from '../../math/Quaternion';
+import { Vector3 } from '../../math/Vector3';
+import { GLTFJson, GLTFJsonAccessor, GLTFJsonNode } from '../../types/gltf';
+import { Material } from '../material/Material';
+import { Diffuse } from '../material/Diffuse';
+import { WasmBuffer } from '../wasm/WasmBuffer';
+import { WasmManager } from '../wasm/WasmManager';
+
+const GLB_MAGIC = 0x46546c67;
+const GLB_CHUNK_JSON = 0x4e4f534a;
+const GLB_CHUNK_BIN = 0x004e4942;
+
+const MODE_TRIANGLES = 4;
+
+// must match MESH_TABLE_STRIDE in wasm/main.cpp
+const MESH_TABLE_STRIDE = 10;
+
+const COMPONENT_BYTES: { [componentType: number]: number } = {
+  5120: 1,
+  5121: 1,
+  5122: 2,
+  5123: 2,
+  5125: 4,
+  5126: 4,
+};
+
+const TYPE_COMPONENTS: { [type: string]: number } = {
+  SCALAR: 1,
+  VEC2: 2,
+  VEC3: 3,
+  VEC4: 4,
+  MAT4: 16,
+};
+
+/**
+ * One primitive placed in the scene
+ *
+ * @interface GLTFScenePrimitive
+ */
+interface GLTFScenePrimitive {
+  mesh: number;
+  primitive: number;
+  matrix: Matrix4;
+  material: Material;
+}
+
+/**
+ * glTF / GLB scene with every node, mesh and primitive.
+ * Accessor data is copied to wasm memory as it is (no conversion to JS number arrays),
+ * and primitives used by several nodes share one BVH in wasm.
+ *
+ * @export
+ * @class GLTFScene
+ */
+export class GLTFScene {
+  private rawJson: GLTFJson | null = null;
+
+  private binaries: ArrayBuffer[] = [];
+
+  private primitives: GLTFScenePrimitive[] = [];
+
+  private buffers: WasmBuffer[] = [];
+
+  /**
+   * Material used when glTF primitive has no material
+   *
+   * @type {Material}
+   * @memberof GLTFScene
+   */
+  public defaultMaterial: Material;
+
+  /**
+   * Materials in the order of glTF materials. Replace elements before createBuffers to override.
+   *
+   * @type {Material[]}
+   * @memberof GLTFScene
+   */
+  public materials: Material[] = [];
+
+  constructor(defaultMaterial: Material = new Diffuse()) {
+    this.defaultMaterial = defaultMaterial;
+  }
+
+  /**
+   * Number of placed primitives (models created in wasm)
+   *
+   * @readonly
+   * @memberof GLTFScene
+   */
+  get count() {
+    return this.primitives.length;
+  }
+
+  /**
+   * Materials used by this scene
+   *
+   * @readonly
+   * @type {Material[]}
+   * @memberof GLTFScene
+   */
+  get usedMaterials(): Material[] {
+    return Array.from(new Set(this.primitives.map((p) => p.material)));
+  }
+
+  /**
+   * load .gltf or .glb
+   *
+   * @param {string} url
+   * @memberof GLTFScene
+   */
+  public async load(url: string) {
+    const response = await fetch(url);
+    const data = await response.arrayBuffer();
+    const view = new DataView(data);
+
+    if (data.byteLength >= 12 && view.getUint32(0, true) === GLB_MAGIC) {
+      this.parseGLB(data);
+    } else {
+      this.rawJson = JSON.parse(new TextDecoder().decode(data));
+      const base = new URL(url, globalThis.location?.href);
+      const buffers = this.rawJson?.buffers;
+      if (!Array.isArray(buffers)) throw new Error('gltf file with array type only');
+      this.binaries = await Promise.all(
+        buffers.map(async ({ uri }) => (await fetch(new URL(uri, base).href)).arrayBuffer())
+      );
+    }
+
+    this.analize();
+  }
+
+  /**
+   * split GLB into JSON chunk and BIN chunk
+   *
+   * @private
+   * @param {ArrayBuffer} data
+   * @memberof GLTFScene
+   */
+  private parseGLB(data: ArrayBuffer) {
+    const view = new DataView(data);
+    const length = Math.min(view.getUint32(8, true), data.byteLength);
+    let offset = 12;
+    while (offset + 8 <= length) {
+      const chunkLength = view.getUint32(offset, true);
+      const chunkType = view.getUint32(offset + 4, true);
+      const chunkStart = offset + 8;
+      if (chunkType === GLB_CHUNK_JSON) {
+        this.rawJson = JSON.parse(
+          new TextDecoder().decode(new Uint8Array(data, chunkStart, chunkLength))
+        );
+      } else if (chunkType === GLB_CHUNK_BIN) {
+        this.binaries = [data.slice(chunkStart, chunkStart + chunkLength)];
+      }
+      offset = chunkStart + chunkLength;
+    }
+    if (!this.rawJson) throw new Error('GLB has no JSON chunk');
+  }
+
+  /**
+   * walk node hierarchy and collect primitives with world matrix
+   *
+   * @private
+   * @memberof GLTFScene
+   */
+  private analize() {
+    if (!this.rawJson) return;
+    const { nodes, meshes, scenes, scene, materials } = this.rawJson;
+
+    if (!Array.isArray(nodes) || !Array.isArray(meshes))
+      throw new Error('gltf file with array type only');
+
+    this.materials = (materials || []).map((m, i) => {
+      if (this.materials[i]) return this.materials[i];
+      const color = m.pbrMetallicRoughness?.baseColorFactor;
+      return color ? new Diffuse(new Vector3(color[0], color[1], color[2])) : this.defaultMaterial;
+    });
+
+    // root nodes: default scene, or every node which is not a child of others
+    let roots: number[];
+    if (Array.isArray(scenes) && scenes.length > 0) {
+      roots = scenes[scene || 0].nodes as number[];
+    } else {
+      const children = new Set(nodes.flatMap((n) => (n.children || []) as number[]));
+      roots = nodes.map((_, i) => i).filter((i) => !children.has(i));
+    }
+
+    this.primitives = [];
+    const visit = (index: number, parent: Matrix4) => {
+      const node = nodes[index];
+      const matrix = parent.multiply(GLTFScene.nodeMatrix(node)) as Matrix4;
+      if (node.mesh !== undefined) {
+        meshes[node.mesh].primitives.forEach((primitive, i) => {
+          if ((primitive.mode ?? MODE_TRIANGLES) !== MODE_TRIANGLES) return;
+          this.primitives.push({
+            mesh: node.mesh as number,
+            primitive: i,
+            matrix,
+            material:
+              primitive.material !== undefined
+                ? this.materials[primitive.material]
+                : this.defaultMaterial,
+          });
+        });
+      }
+      ((node.children || []) as number[]).forEach((child) => visit(child, matrix));
+    };
+    roots.forEach((root) => visit(root, new Matrix4()));
+  }
+
+  /**
+   * local transform matrix of node
+   *
+   * @private
+   * @static
+   * @param {GLTFJsonNode} node
+   * @return {*}  {Matrix4}
+   * @memberof GLTFScene
+   */
+  private static nodeMatrix(node: GLTFJsonNode): Matrix4 {
+    if (node.matrix) return new Matrix4(node.matrix.slice());
+
+    const t = node.translation || [0, 0, 0];
+    const r = node.rotation || [0, 0, 0, 1];
+    const s = node.scale || [1, 1, 1];
+
+    const translate = new Matrix4().translateMatrix(new Vector3(t[0], t[1], t[2]));
+    const scale = new Matrix4().scaleMatrix(new Vector3(s[0], s[1], s[2]));
+    const rotation = new Quaternion(new Vector3(r[0], r[1], r[2]), r[3]).matrix();
+
+    return translate.multiply(rotation.multiply(scale)) as Matrix4;
+  }
+
+  /**
+   * tightly packed bytes of accessor (view of the binary when possible)
+   *
+   * @private
+   * @param {GLTFJsonAccessor} accessor
+   * @return {*}  {Uint8Array}
+   * @memberof GLTFScene
+   */
+  private accessorBytes(accessor: GLTFJsonAccessor): Uint8Array {
+    const bufferViews = this.rawJson?.bufferViews;
+    if (!Array.isArray(bufferViews)) throw new Error('gltf file with array type only');
+
+    const view = bufferViews[accessor.bufferView as number];
+    const elementSize = COMPONENT_BYTES[accessor.componentType] * TYPE_COMPONENTS[accessor.type];
+    const stride = view.byteStride || elementSize;
+    const binary = this.binaries[view.buffer as number];
+    const start = (view.byteOffset || 0) + (accessor.byteOffset || 0);
+
+    if (stride === elementSize) {
+      return new Uint8Array(binary, start, accessor.count * elementSize);
+    }
+
+    const src = new Uint8Array(binary);
+    const packed = new Uint8Array(accessor.count * elementSize);
+    for (let i = 0; i < accessor.count; i += 1) {
+      packed.set(src.subarray(start + i * stride, start + i * stride + elementSize), i * elementSize);
+    }
+    return packed;
+  }
+
+  /**
+   * copy accessor to wasm memory as float array (non-float accessor is converted)
+   *
+   * @private
+   * @param {WasmManager} manager
+   * @param {GLTFJsonAccessor} accessor
+   * @return {*}  {WasmBuffer}
+   * @memberof GLTFScene
+   */
+  private createFloatBuffer(manager: WasmManager, accessor: GLTFJsonAccessor): WasmBuffer {
+    const bytes = this.accessorBytes(accessor);
+    const components = TYPE_COMPONENTS[accessor.type];
+    const buffer = manager.createBuffer('float', accessor.count * components);
+
+    if (accessor.componentType === 5126) {
+      buffer.setBytes(bytes);
+    } else {
+      const data = new DataView(bytes.buffer, bytes.byteOffset, bytes.byteLength);
+      const size = COMPONENT_BYTES[accessor.componentType];
+      const values = new Float32Array(accessor.count * components);
+      for (let i = 0; i < values.length; i += 1) {
+        if (accessor.componentType === 5121) values[i] = data.getUint8(i) / 255;
+        else if (accessor.componentType === 5123) values[i] = data.getUint16(i * size, true) / 65535;
+        else if (accessor.componentType === 5120) values[i] = Math.max(data.getInt8(i) / 127, -1);
+        else values[i] = Math.max(data.getInt16(i * size, true) / 32767, -1);
+      }
+      buffer.setArray(values);
+    }
+    return buffer;
+  }
+
+  /**
+   * copy index accessor to wasm memory as it is
+   *
+   * @private
+   * @param {WasmManager} manager
+   * @param {GLTFJsonAccessor} accessor
+   * @return {*}  {WasmBuffer}
+   * @memberof GLTFScene
+   */
+  private createIndexBuffer(manager: WasmManager, accessor: GLTFJsonAccessor): WasmBuffer {
+    const bytes = this.accessorBytes(accessor);
+    const buffer = manager.createBuffer('i32', Math.ceil(bytes.byteLength / 4));
+    buffer.setBytes(bytes);
+    return buffer;
+  }
+
+  /**
+   * Copy all primitives to wasm and create mesh table for createMeshes.
+   * Material buffers must be created before this.
+   *
+   * @param {WasmManager} manager
+   * @return {*}  {WasmBuffer} mesh table (MESH_TABLE_STRIDE ints per primitive)
+   * @memberof GLTFScene
+   */
+  public createBuffers(manager: WasmManager): WasmBuffer {
+    if (!this.rawJson) throw new Error('gltf is not loaded');
+    const { meshes, accessors } = this.rawJson;
+    if (!Array.isArray(meshes) || !Array.isArray(accessors))
+      throw new Error('gltf file with array type only');
+
+    this.release();
+
+    const accessorCache = new Map<number, WasmBuffer>();
+    const floatAccessor = (index: number | string | undefined) => {
+      if (index === undefined) return null;
+      const i = index as number;
+      if (!accessorCache.has(i)) accessorCache.set(i, this.createFloatBuffer(manager, accessors[i]));
+      return accessorCache.get(i) as WasmBuffer;
+    };
+
+    const firstUse = new Map<string, number>();
+    const table = manager.createBuffer('i32', this.primitives.length * MESH_TABLE_STRIDE);
+
+    this.primitives.forEach(({ mesh, primitive, matrix, material }, index) => {
+      const { attributes, indices } = meshes[mesh].primitives[primitive];
+      const position = accessors[attributes.POSITION as number];
+
+      const matrixBuffer = manager.createBuffer('float', 32);
+      matrixBuffer.setArray(matrix.matrix.concat(matrix.inverse().matrix));
+      this.buffers.push(matrixBuffer);
+
+      const entry = new Array<number>(MESH_TABLE_STRIDE).fill(0);
+      entry[7] = matrixBuffer.getPointer();
+      entry[8] = (material.buffer as WasmBuffer).getPointer();
+      entry[9] = -1;
+
+      const key = `${mesh}/${primitive}`;
+      const source = firstUse.get(key);
+      if (source !== undefined) {
+        entry[9] = source;
+      } else {
+        firstUse.set(key, index);
+
+        let indexBuffer: WasmBuffer;
+        let indexCount: number;
+        let indexSize = 4;
+        if (indices !== undefined) {
+          const accessor = accessors[indices as number];
+          indexBuffer = this.createIndexBuffer(manager, accessor);
+          indexCount = accessor.count;
+          indexSize = COMPONENT_BYTES[accessor.componentType];
+        } else {
+          // non-indexed primitive
+          indexCount = position.count;
+          indexBuffer = manager.createBuffer('i32', indexCount);
+          indexBuffer.setArray(Int32Array.from({ length: indexCount }, (_, i) => i));
+        }
+        this.buffers.push(indexBuffer);
+
+        const normal = floatAccessor(attributes.NORMAL);
+        const texcoord = floatAccessor(attributes.TEXCOORD_0);
+
+        entry[0] = (floatAccessor(attributes.POSITION) as WasmBuffer).getPointer();
+        entry[1] = position.count;
+        entry[2] = indexBuffer.getPointer();
+        entry[3] = Math.floor(indexCount / 3);
+        entry[4] = indexSize;
+        entry[5] = normal ? normal.getPointer() : 0;
+        entry[6] = texcoord ? texcoord.getPointer() : 0;
+      }
+
+      entry.forEach((value, i) => table.set(index * MESH_TABLE_STRIDE + i, value));
+    });
+
+    accessorCache.forEach((buffer) => this.buffers.push(buffer));
+    this.buffers.push(table);
+    return table;
+  }
+
+  /**
+   * Release vertex buffers (wasm keeps its own copy after createMeshes)
+   *
+   * @memberof GLTFScene
+   */
+  public release() {
+    this.buffers.forEach((buffer) => buffer.release());
+    this.buffers = [];
+  }
+}
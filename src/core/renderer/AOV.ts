@@ -0,0 +1,31 @@
+/**
+ * Arbitrary output variables written on the primary hit.
+ * Values must match AOVType in src/wasm/raytracer/aov.hpp.
+ *
+ * @export
+ * @enum {number}
+ */
+export enum AOVType {
+  Depth = 0,
+  Normal = 1,
+  Albedo = 2,
+  MaterialID = 3,
+  ObjectID = 4,
+  UV = 5,
+  HitCount = 6,
+  TraversalCost = 7,
+}
+
+/**
+ * Number of float channels per pixel for each AOV.
+ */
+export const AOV_CHANNELS: { [key in AOVType]: number } = {
+  [AOVType.Depth]: 1,
+  [AOVType.Normal]: 3,
+  [AOVType.Albedo]: 3,
+  [AOVType.MaterialID]: 1,
+  [AOVType.ObjectID]: 1,
+  [AOVType.UV]: 2,
+  [AOVType.HitCount]: 1,
+  [AOVType.TraversalCost]: 1,
+};
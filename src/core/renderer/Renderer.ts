@@ -1,11 +1,29 @@
 /* eslint-disable no-console */
 import { Model } from '../model/Model';
+import { GLTFScene } from '../model/GLTFScene';
+import { Material } from '../material/Material';
 import { WasmBuffer } from '../wasm/WasmBuffer';
 import { WasmManager } from '../wasm/WasmManager';
 import { Camera } from '../camera/Camera';
+import { AOVType, AOV_CHANNELS } from './AOV';
+import { OutputEncoding, ToneCurve, encodePFM } from './ToneMapping';
+import { MemoryUsage, RayHits, RenderStats, TileRegion } from '../../types/wasm';
 
 const TEXTURE_SIZE = 1024;
 
+/**
+ * Progress of time-budgeted rendering
+ *
+ * @export
+ * @interface RenderProgress
+ */
+export interface RenderProgress {
+  pixelsDone: number;
+  totalPixels: number;
+  samplesDone: number;
+  remainingMs: number;
+}
+
 /**
  * Image renderer. pass model and render image.
  *
@@ -23,6 +41,17 @@ export class Renderer {
 
   private cameraBuf: WasmBuffer | null = null;
 
+  private renderSize: { width: number; height: number } | null = null;
+
+  private progressBuf: WasmBuffer | null = null;
+
+  private _progress: RenderProgress = {
+    pixelsDone: 0,
+    totalPixels: 0,
+    samplesDone: 0,
+    remainingMs: 0,
+  };
+
   // partial rendering context
   private renderCtx: {
     width: number;
@@ -51,19 +80,13 @@ export class Renderer {
   /**
    * Create BVH.
    *
-   * @return {*}
+   * @param {Model} model
+   * @return {*}  {number} index of the new model (for updateModel), -1 if nothing was added
    * @memberof Renderer
    */
   public createBound(model: Model) {
     model.createBuffers(this.wasmManager, this.textureCanvas);
-
-    const { texture } = model.material;
-
-    if (texture && texture.isValid() && texture.id < 0 && texture.buffer) {
-      const id = this.wasmManager.callFunction('createTexture', texture.buffer);
-      texture.id = id;
-      model.material.createBuffers(this.wasmManager, this.textureCanvas);
-    }
+    this.createMaterial(model.material);
 
     return this.wasmManager.callCreateBounding(
       model.positionBuffer as WasmBuffer,
@@ -79,6 +102,199 @@ export class Renderer {
     );
   }
 
+  /**
+   * Create BVHs of every primitive in the scene with one wasm call.
+   *
+   * @param {GLTFScene} scene
+   * @return {*}  {number} index of the first created model, -1 if nothing was added
+   * @memberof Renderer
+   */
+  public createScene(scene: GLTFScene) {
+    scene.usedMaterials.forEach((material) => this.createMaterial(material));
+
+    const table = scene.createBuffers(this.wasmManager);
+    const result = this.wasmManager.callCreateMeshes(scene.count, table);
+    scene.release();
+
+    return result;
+  }
+
+  /**
+   * Replace transform and material of a created model.
+   * Like createBound and createScene, this may be called while rendering:
+   * the pass in progress keeps its scene and the edit shows from the next pass.
+   *
+   * @param {number} index index returned by createBound (createScene: first index + mesh order)
+   * @param {Model} model
+   * @return {*}  {number} 0 on success, -1 if the index is invalid
+   * @memberof Renderer
+   */
+  public updateModel(index: number, model: Model) {
+    model.createBuffers(this.wasmManager, this.textureCanvas);
+    this.createMaterial(model.material);
+
+    const result = this.wasmManager.callSetModelTransform(index, model.matrixBuffer as WasmBuffer);
+    if (result < 0) return result;
+    return this.wasmManager.callSetModelMaterial(index, model.material.buffer as WasmBuffer);
+  }
+
+  /**
+   * Create material buffer and upload its texture.
+   *
+   * @private
+   * @param {Material} material
+   * @memberof Renderer
+   */
+  private createMaterial(material: Material) {
+    material.createBuffers(this.wasmManager, this.textureCanvas);
+
+    const { texture } = material;
+    if (texture && texture.isValid() && texture.id < 0 && texture.buffer) {
+      const id = this.wasmManager.callFunction('createTexture', texture.buffer);
+      // wasm copies the pixels, so the upload buffer is not needed anymore
+      texture.release();
+      if (id < 0) {
+        console.error('Texture does not fit in memory budget.');
+        return;
+      }
+      texture.id = id;
+      material.createBuffers(this.wasmManager, this.textureCanvas);
+    }
+  }
+
+  /**
+   * Enable edge-aware denoiser applied at the end of rendering.
+   *
+   * @param {boolean} enabled
+   * @param {number} [iterations=0] à-trous iterations (0 keeps current value)
+   * @memberof Renderer
+   */
+  public setDenoise(enabled: boolean, iterations: number = 0) {
+    return this.wasmManager.callSetDenoise(enabled ? 1 : 0, iterations);
+  }
+
+  /**
+   * Write first hit AOVs (read by getAOV) while rendering. On by default;
+   * turning them off lets the renderer pick an integrator without G-buffer writes.
+   * The denoiser needs them, so they are always written while it is enabled.
+   *
+   * @param {boolean} enabled
+   * @memberof Renderer
+   */
+  public setAOVs(enabled: boolean) {
+    return this.wasmManager.callSetAOVs(enabled ? 1 : 0);
+  }
+
+  /**
+   * Set how the finished HDR image is turned into 8 bit pixels. Takes effect
+   * when the next render finishes; call applyToneMapping to update the last one.
+   *
+   * @param {number} exposure exposure in stops (EV)
+   * @param {ToneCurve} [curve=ToneCurve.None]
+   * @param {OutputEncoding} [encoding=OutputEncoding.Gamma22]
+   * @param {boolean} [dither=false] spread quantization error with an ordered 8x8 pattern
+   * @return {*}  {number} 0 on success, -1 for invalid values
+   * @memberof Renderer
+   */
+  public setToneMapping(
+    exposure: number,
+    curve: ToneCurve = ToneCurve.None,
+    encoding: OutputEncoding = OutputEncoding.Gamma22,
+    dither: boolean = false
+  ): number {
+    return this.wasmManager.callSetToneMapping(exposure, curve, encoding, dither ? 1 : 0);
+  }
+
+  /**
+   * Store BVH nodes with child bounds quantized to 8 or 16 bits relative to the parent.
+   * Applies to created and future models; compressed models cannot be restored.
+   * Memory is reported in getStats().scene.
+   *
+   * @param {(0 | 8 | 16)} bits 0 keeps full precision nodes
+   * @memberof Renderer
+   */
+  public setBVHCompression(bits: 0 | 8 | 16) {
+    return this.wasmManager.callSetBVHCompression(bits);
+  }
+
+  /**
+   * Build BVH of models created after this call with SAH and spatial splits (SBVH).
+   * Long thin triangles may be referenced from several leaves, up to
+   * budget * triangle count extra references. Slower to build, faster to render.
+   *
+   * @param {number} budget 0 uses the default median split builder
+   * @memberof Renderer
+   */
+  public setBVHSpatialSplits(budget: number) {
+    return this.wasmManager.callSetBVHSpatialSplits(budget);
+  }
+
+  /**
+   * Trace all paths of a tile bounce by bounce instead of pixel by pixel.
+   * With mode 2, secondary rays are sorted by origin cell and direction octant
+   * before traversal so that rays visiting the same BVH subtrees run together.
+   * Compare nodeVisits and tile times of getStats() to choose the mode.
+   *
+   * @param {(0 | 1 | 2)} mode 0: per pixel, 1: batch, 2: batch with ray sorting
+   * @memberof Renderer
+   */
+  public setRayBatching(mode: 0 | 1 | 2) {
+    return this.wasmManager.callSetRayBatching(mode);
+  }
+
+  /**
+   * Find camera hits with a tiled software rasterizer (visibility buffer)
+   * instead of tracing primary rays. Paths start from the first bounce.
+   * The image is the same; only the cost of primary visibility changes.
+   *
+   * @param {boolean} enabled
+   * @memberof Renderer
+   */
+  public setRasterization(enabled: boolean) {
+    return this.wasmManager.callSetRasterization(enabled ? 1 : 0);
+  }
+
+  /**
+   * Start each restarted render (after a camera or scene change) with a
+   * 1/scale resolution 1 spp preview, refined by halving the scale before the
+   * full resolution pass. Preview samples are shown but not accumulated.
+   *
+   * @param {(0 | 2 | 4 | 8 | 16)} scale 0 disables the preview
+   * @memberof Renderer
+   */
+  public setPreview(scale: 0 | 2 | 4 | 8 | 16) {
+    return this.wasmManager.callSetPreview(scale);
+  }
+
+  /**
+   * Cache outgoing radiance of diffuse surfaces in a hashed world-space grid.
+   * Paths from the second vertex on stop at trained cells, which shortens them
+   * several times at the cost of some blur and bias. Meant for previews.
+   * The cache survives camera moves and is cleared when the scene changes.
+   *
+   * @param {boolean} enabled
+   * @param {number} [cellSize=0.25] grid cell width in world units
+   * @param {number} [blend=0.05] minimum weight of a new sample (higher adapts faster)
+   * @memberof Renderer
+   */
+  public setRadianceCache(enabled: boolean, cellSize: number = 0.25, blend: number = 0.05) {
+    return this.wasmManager.callSetRadianceCache(enabled ? 1 : 0, cellSize, blend);
+  }
+
+  /**
+   * Guide diffuse bounces with per-cell directional histograms learned from
+   * previous passes, mixed with BSDF sampling. Unbiased; helps where light
+   * arrives through narrow openings. Learning is cleared when the scene changes.
+   *
+   * @param {boolean} enabled
+   * @param {number} [cellSize=0.25] grid cell width in world units
+   * @param {number} [fraction=0.5] probability of sampling the learned distribution (0 < fraction < 1)
+   * @memberof Renderer
+   */
+  public setPathGuiding(enabled: boolean, cellSize: number = 0.25, fraction: number = 0.5) {
+    return this.wasmManager.callSetPathGuiding(enabled ? 1 : 0, cellSize, fraction);
+  }
+
   /**
    * Render image to canvas
    *
@@ -111,6 +327,7 @@ export class Renderer {
     this.wasmManager.callSetCamera(this.cameraBuf);
 
     const result = this.wasmManager.callPathTracer(this.pixelData, width, height);
+    this.renderSize = { width, height };
 
     if (result < 0) {
       console.error('Path trace failed.');
@@ -175,6 +392,7 @@ export class Renderer {
     this.wasmManager.callSetCamera(this.cameraBuf);
 
     const result = this.wasmManager.callPathTracer(pixelData, width, height);
+    this.renderSize = { width, height };
 
     if (result < 0) {
       console.error('Path trace failed.');
@@ -184,7 +402,50 @@ export class Renderer {
     return 1;
   }
 
-  public partialRendering(update: boolean = true) {
+  /**
+   * Move the camera while partial rendering is in progress.
+   * The next partialRendering call drops the rest of the pass and restarts
+   * from the preview (see setPreview).
+   *
+   * @param {Camera} camera
+   * @memberof Renderer
+   */
+  public updateCamera(camera: Camera) {
+    if (!this.cameraBuf) this.cameraBuf = this.wasmManager.createBuffer('float', 13);
+    this.cameraBuf.setArray(camera.dumpAsArray());
+    return this.wasmManager.callSetCamera(this.cameraBuf);
+  }
+
+  /**
+   * Progress of partial rendering, updated by time-budgeted partialRendering calls.
+   *
+   * @readonly
+   * @type {RenderProgress}
+   * @memberof Renderer
+   */
+  get progress(): RenderProgress {
+    return this._progress;
+  }
+
+  /**
+   * Set samples per pixel of the next render.
+   *
+   * @param {number} spp
+   * @memberof Renderer
+   */
+  public setSamplesPerPixel(spp: number) {
+    return this.wasmManager.callSetSamplesPerPixel(spp);
+  }
+
+  /**
+   * Render next part of the image.
+   *
+   * @param {boolean} [update=true] put image to canvas
+   * @param {number} [budgetMs=0] time budget of this call in milliseconds (0 renders fixed 10 lines)
+   * @return {*}
+   * @memberof Renderer
+   */
+  public partialRendering(update: boolean = true, budgetMs: number = 0) {
     if (this.renderCtx == null) {
       return -1;
     }
@@ -193,7 +454,19 @@ export class Renderer {
 
     const pixels = imageData.data;
 
-    const result = this.wasmManager.callReadStream(pixelData);
+    let result: number;
+    if (budgetMs > 0) {
+      if (!this.progressBuf) this.progressBuf = this.wasmManager.createBuffer('float', 4);
+      result = this.wasmManager.callReadStreamFor(pixelData, budgetMs, this.progressBuf);
+      this._progress = {
+        pixelsDone: this.progressBuf.get(0),
+        totalPixels: this.progressBuf.get(1),
+        samplesDone: this.progressBuf.get(2),
+        remainingMs: this.progressBuf.get(3),
+      };
+    } else {
+      result = this.wasmManager.callReadStream(pixelData);
+    }
 
     if (result < 0) {
       console.error('Path trace failed.');
@@ -213,6 +486,330 @@ export class Renderer {
     return result;
   }
 
+  /**
+   * Read an AOV of the last render (written in the same pass as the color).
+   * Pixels are row-major with AOV_CHANNELS[type] floats each.
+   *
+   * @param {AOVType} type
+   * @return {*}  {(Float32Array | null)}
+   * @memberof Renderer
+   */
+  public getAOV(type: AOVType): Float32Array | null {
+    if (!this.renderSize) return null;
+
+    const { width, height } = this.renderSize;
+    const channels = AOV_CHANNELS[type];
+    const buffer = this.wasmManager.createBuffer('float', width * height * channels);
+    const result = this.wasmManager.callGetAOV(type, buffer);
+
+    let aov: Float32Array | null = null;
+    if (result === channels) {
+      aov = new Float32Array(buffer.length);
+      for (let i = 0; i < aov.length; i += 1) {
+        aov[i] = buffer.get(i);
+      }
+    }
+    buffer.release();
+    return aov;
+  }
+
+  /**
+   * Linear RGB of the last finished render after filtering and denoising,
+   * 3 floats per pixel with rows from the top. The array is a view of wasm
+   * memory, not a copy: it is only valid until the next render finishes or
+   * the wasm memory grows, so copy it with slice() to keep it.
+   *
+   * @return {*}  {({ data: Float32Array; width: number; height: number } | null)}
+   * @memberof Renderer
+   */
+  public getHDR(): { data: Float32Array; width: number; height: number } | null {
+    const size = this.wasmManager.createBuffer('i32', 2);
+    const pointer = this.wasmManager.callGetHDR(size);
+    const width = size.get(0);
+    const height = size.get(1);
+    size.release();
+    if (!pointer) return null;
+    return { data: this.wasmManager.viewFloat32(pointer, width * height * 3), width, height };
+  }
+
+  /**
+   * Last finished render as a PFM file (linear float RGB).
+   *
+   * @return {*}  {(Uint8Array | null)}
+   * @memberof Renderer
+   */
+  public exportPFM(): Uint8Array | null {
+    const hdr = this.getHDR();
+    if (!hdr) return null;
+    return encodePFM(hdr.data, hdr.width, hdr.height);
+  }
+
+  /**
+   * Tone map the last finished render again with the current setToneMapping
+   * values and put it to the canvas. No rays are traced, so changing the
+   * exposure in a viewer costs only this conversion.
+   *
+   * @param {(HTMLCanvasElement | OffscreenCanvas)} canvas
+   * @return {*}  {number} 0 on success, -1 if no render has finished yet
+   * @memberof Renderer
+   */
+  public applyToneMapping(canvas: HTMLCanvasElement | OffscreenCanvas): number {
+    const hdr = this.getHDR();
+    const ctx = canvas.getContext('2d');
+    if (!hdr || !ctx) return -1;
+
+    const imageData = ctx.createImageData(hdr.width, hdr.height);
+    const pixelData = this.wasmManager.createBuffer('i32', imageData.data.length);
+    const result = this.wasmManager.callApplyToneMapping(pixelData);
+    if (result === 0) {
+      imageData.data.set(pixelData.getArray());
+      ctx.putImageData(imageData, 0, 0);
+    }
+    pixelData.release();
+    return result;
+  }
+
+  /**
+   * Get statistics of the last render. Counters stay zero unless wasm is
+   * built with `make build FLAGS=-DRAYTRACER_STATS`.
+   *
+   * @return {*}  {RenderStats}
+   * @memberof Renderer
+   */
+  public getStats(): RenderStats {
+    return this.wasmManager.callGetStats();
+  }
+
+  /**
+   * Limit memory of geometry, BVH, textures and framebuffers.
+   * Meshes and resolutions over the budget are rejected (return -1),
+   * textures are downsampled until they fit.
+   *
+   * @param {number} megabytes 0 removes the limit
+   * @memberof Renderer
+   */
+  public setMemoryBudget(megabytes: number) {
+    return this.wasmManager.callSetMemoryBudget(megabytes);
+  }
+
+  /**
+   * Get memory used by each part of the renderer.
+   *
+   * @return {*}  {MemoryUsage}
+   * @memberof Renderer
+   */
+  public getMemoryUsage(): MemoryUsage {
+    return this.wasmManager.callGetMemoryUsage();
+  }
+
+  /**
+   * Save accumulated samples, per-pixel sample counts, RNG state and learned
+   * caches. Loading it into the same scene and settings continues the render
+   * bit-for-bit. Available between passes, or mid-pass after the preview
+   * (at tile boundaries when rasterization is on).
+   *
+   * @return {*}  {(Uint8Array | null)} null if a checkpoint cannot be taken now
+   * @memberof Renderer
+   */
+  public saveCheckpoint(): Uint8Array | null {
+    const bytes = this.wasmManager.callCreateCheckpoint();
+    if (bytes < 0) return null;
+    const buffer = this.wasmManager.createBuffer('i32', Math.ceil(bytes / 4));
+    this.wasmManager.callCopyCheckpoint(buffer);
+    const words = buffer.getArray() as Int32Array;
+    buffer.release();
+    return new Uint8Array(words.buffer, 0, bytes);
+  }
+
+  /**
+   * Restore a checkpoint made by saveCheckpoint. Create the same scene and
+   * apply the same settings first; the camera is restored from the checkpoint.
+   * A checkpoint taken mid-pass resumes that pass on the next readStream.
+   *
+   * @param {Uint8Array} data
+   * @return {*}  {number} 0 on success, -1 if it does not match the current scene or settings
+   * @memberof Renderer
+   */
+  public loadCheckpoint(data: Uint8Array): number {
+    const buffer = this.wasmManager.createBuffer('i32', Math.ceil(data.length / 4));
+    buffer.setBytes(data);
+    const result = this.wasmManager.callLoadCheckpoint(buffer, data.length);
+    buffer.release();
+    return result;
+  }
+
+  /**
+   * Render a region of a width x height frame without touching the accumulation
+   * buffer. Each pixel gets [r, g, b sum, sample count]. The same seed gives
+   * the same result on any instance with the same scene, so lost tiles can be
+   * reissued (see TileCoordinator). Keep radiance cache and path guiding off.
+   * The camera is used for this call only, so a progressive render on the same
+   * instance keeps its camera and accumulation.
+   *
+   * @param {(Camera | number[])} camera camera or its dumpAsArray()
+   * @param {number} width frame width
+   * @param {number} height frame height
+   * @param {TileRegion} region
+   * @param {number} spp samples per pixel
+   * @param {number} seed
+   * @return {*}  {(Float32Array | null)} region.width * region.height * 4 floats, null on failure
+   * @memberof Renderer
+   */
+  public renderRegion(
+    camera: Camera | number[],
+    width: number,
+    height: number,
+    region: TileRegion,
+    spp: number,
+    seed: number
+  ): Float32Array | null {
+    if (!this.cameraBuf) this.cameraBuf = this.wasmManager.createBuffer('float', 13);
+    this.cameraBuf.setArray(Array.isArray(camera) ? camera : camera.dumpAsArray());
+
+    const buffer = this.wasmManager.createBuffer('float', region.width * region.height * 4);
+    const result = this.wasmManager.callRenderRegion(
+      this.cameraBuf,
+      width,
+      height,
+      region.x,
+      region.y,
+      region.width,
+      region.height,
+      spp,
+      seed,
+      buffer
+    );
+    const data = result < 0 ? null : (buffer.getArray() as Float32Array);
+    buffer.release();
+    return data;
+  }
+
+  /**
+   * Find the closest hits of many rays in one call (picking, visibility, etc.).
+   * `rays` is structure-of-arrays: ox[N], oy[N], oz[N], dx[N], dy[N], dz[N], tMin[N], tMax[N].
+   * t is measured in units of the direction length. prim is the polygon index of the mesh.
+   *
+   * @param {Float32Array} rays
+   * @return {*}  {RayHits}
+   * @memberof Renderer
+   */
+  public intersectRays(rays: Float32Array): RayHits {
+    const count = Math.floor(rays.length / 8);
+    const rayBuf = this.wasmManager.createBuffer('float', count * 8);
+    const hitBuf = this.wasmManager.createBuffer('float', count * 3);
+    const idBuf = this.wasmManager.createBuffer('i32', count * 2);
+    rayBuf.setArray(rays.subarray(0, count * 8));
+
+    this.wasmManager.callIntersectRays(count, rayBuf, hitBuf, idBuf);
+
+    const hits = hitBuf.getArray() as Float32Array;
+    const ids = idBuf.getArray() as Int32Array;
+    rayBuf.release();
+    hitBuf.release();
+    idBuf.release();
+    return {
+      count,
+      t: hits.subarray(0, count),
+      u: hits.subarray(count, count * 2),
+      v: hits.subarray(count * 2, count * 3),
+      model: ids.subarray(0, count),
+      prim: ids.subarray(count, count * 2),
+    };
+  }
+
+  /**
+   * Test whether each ray hits anything between tMin and tMax.
+   * Layout of `rays` is the same as intersectRays. Stops at the first hit, so it is cheaper.
+   *
+   * @param {Float32Array} rays
+   * @return {*}  {Int32Array} 1 if occluded, 0 otherwise
+   * @memberof Renderer
+   */
+  public occludedRays(rays: Float32Array): Int32Array {
+    const count = Math.floor(rays.length / 8);
+    const rayBuf = this.wasmManager.createBuffer('float', count * 8);
+    const occludedBuf = this.wasmManager.createBuffer('i32', count);
+    rayBuf.setArray(rays.subarray(0, count * 8));
+
+    this.wasmManager.callOccludedRays(count, rayBuf, occludedBuf);
+
+    const occluded = occludedBuf.getArray() as Int32Array;
+    rayBuf.release();
+    occludedBuf.release();
+    return occluded;
+  }
+
+  /**
+   * Select the mesh to bake and unwrap it with its second UV set.
+   * The model must already be created (e.g. by createBound) as the `modelIndex`-th model,
+   * and `model` must be the same geometry: its triangle count is checked against that model.
+   *
+   * @param {number} modelIndex
+   * @param {Model} model
+   * @param {Float32Array} uv2 lightmap UV per vertex (0..1)
+   * @param {number} size lightmap width and height in texels
+   * @return {*}  {number} number of covered texels, -1 if the model does not match,
+   *   an index is out of range or the memory budget is exceeded
+   * @memberof Renderer
+   */
+  public setLightmapTarget(modelIndex: number, model: Model, uv2: Float32Array, size: number): number {
+    const position = this.wasmManager.createBuffer('float', model.position.length);
+    const normal = this.wasmManager.createBuffer('float', model.normal.length);
+    const indicies = this.wasmManager.createBuffer('i32', model.indicies.length);
+    const uv = this.wasmManager.createBuffer('float', uv2.length);
+    position.setArray(model.position);
+    normal.setArray(model.normal);
+    indicies.setArray(model.indicies);
+    uv.setArray(uv2);
+
+    const result = this.wasmManager.callSetLightmapTarget(
+      modelIndex,
+      position,
+      model.position.length / 3,
+      indicies,
+      model.indicies.length / 3,
+      model.normal.length > 0 ? normal : 0,
+      uv,
+      size
+    );
+
+    position.release();
+    normal.release();
+    indicies.release();
+    uv.release();
+    return result;
+  }
+
+  /**
+   * Add samples to every texel of the lightmap. Call repeatedly to refine progressively.
+   *
+   * @param {('irradiance' | 'ao')} mode irradiance runs the path tracer, ao only tests occlusion
+   * @param {number} samples samples per texel added by this call
+   * @param {number} [aoDistance=0] occlusion range of ao (0 is unlimited)
+   * @return {*}  {number} total samples per texel, -1 if no target
+   * @memberof Renderer
+   */
+  public bakeLightmap(mode: 'irradiance' | 'ao', samples: number, aoDistance: number = 0): number {
+    return this.wasmManager.callBakeLightmap(mode === 'ao' ? 1 : 0, samples, aoDistance);
+  }
+
+  /**
+   * Read the baked lightmap as RGBA floats (size * size * 4).
+   * Alpha is 1 on covered texels, 0.5 on texels filled by dilation and 0 elsewhere.
+   *
+   * @param {number} size same size as setLightmapTarget
+   * @param {number} [dilation=2] texels to grow over UV seams
+   * @return {*}  {(Float32Array | null)}
+   * @memberof Renderer
+   */
+  public readLightmap(size: number, dilation: number = 2): Float32Array | null {
+    const buffer = this.wasmManager.createBuffer('float', size * size * 4);
+    const result = this.wasmManager.callReadLightmap(buffer, dilation);
+    const lightmap = result < 0 ? null : (buffer.getArray() as Float32Array);
+    buffer.release();
+    return lightmap;
+  }
+
   /**
    * Release buffers.
    *
@@ -227,5 +824,9 @@ export class Renderer {
       this.cameraBuf.release();
       this.cameraBuf = null;
     }
+    if (this.progressBuf) {
+      this.progressBuf.release();
+      this.progressBuf = null;
+    }
   }
 }
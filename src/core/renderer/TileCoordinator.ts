@@ -0,0 +1,374 @@
+import { Camera } from '../camera/Camera';
+import { TileRegion } from '../../types/wasm';
+import { Renderer } from './Renderer';
+
+/**
+ * Anything that carries messages to a tile worker: a Worker, a MessagePort,
+ * or an adapter around a socket to a remote host.
+ *
+ * @export
+ * @interface TileEndpoint
+ */
+export interface TileEndpoint {
+  postMessage(message: unknown, transfer?: Transferable[]): void;
+  // eslint-disable-next-line @typescript-eslint/no-explicit-any
+  addEventListener(type: 'message' | 'error', listener: (event: any) => void): void;
+}
+
+/**
+ * One unit of work: a rectangle of the frame and a range of its samples
+ *
+ * @export
+ * @interface TileTask
+ */
+export interface TileTask extends TileRegion {
+  id: number;
+  frame: number;
+  spp: number;
+  seed: number;
+}
+
+/**
+ * Message from the coordinator to a worker
+ */
+export interface TileRequest {
+  type: 'tile';
+  task: TileTask;
+  camera: number[];
+  frameWidth: number;
+  frameHeight: number;
+}
+
+/**
+ * Message from a worker to the coordinator. data is [r, g, b sum, sample count] per pixel
+ */
+export type TileResponse =
+  | { type: 'tile-result'; id: number; frame: number; data: Float32Array }
+  | { type: 'tile-error'; id: number; frame: number };
+
+export interface TileCoordinatorOptions {
+  /** tile width and height in pixels */
+  tileSize: number;
+  /** samples per pixel of one task (0 renders all samples of a tile in one task) */
+  samplesPerTask: number;
+  /**
+   * reissue a task if its worker does not answer within this time (0 waits forever).
+   * A timeout counts as a failed attempt, but the worker keeps getting tasks.
+   */
+  timeoutMs: number;
+  /** give up the frame when one task failed or timed out this many times */
+  maxAttempts: number;
+}
+
+/**
+ * Answer tile requests with the given renderer. Call this in the worker after
+ * creating the same scene as every other worker.
+ *
+ * @export
+ * @param {Renderer} renderer
+ * @param {TileEndpoint} scope worker global scope or the coordinator side of a connection
+ */
+export const serveTiles = (renderer: Renderer, scope: TileEndpoint) => {
+  scope.addEventListener('message', (event: MessageEvent) => {
+    const request = event.data as TileRequest;
+    if (!request || request.type !== 'tile') return;
+    const { task } = request;
+    const data = renderer.renderRegion(
+      request.camera,
+      request.frameWidth,
+      request.frameHeight,
+      task,
+      task.spp,
+      task.seed
+    );
+    if (!data) {
+      scope.postMessage({ type: 'tile-error', id: task.id, frame: task.frame });
+      return;
+    }
+    scope.postMessage({ type: 'tile-result', id: task.id, frame: task.frame, data }, [data.buffer]);
+  });
+};
+
+interface WorkerState {
+  endpoint: TileEndpoint;
+  task: TileTask | null;
+  timer: ReturnType<typeof setTimeout> | null;
+  // reported an error event; a slow worker that only timed out is not lost
+  lost: boolean;
+}
+
+/**
+ * Split one frame into tiles and sample ranges, let workers pull them and merge
+ * the float results weighted by their sample counts. A task whose worker fails
+ * or times out goes back to the queue; since tasks are seeded, a late duplicate
+ * is identical and is simply dropped. The frame fails when a task runs out of
+ * attempts or every worker has reported an error.
+ *
+ * @export
+ * @class TileCoordinator
+ */
+export class TileCoordinator {
+  private workers: WorkerState[];
+
+  private options: TileCoordinatorOptions;
+
+  private frame = 0;
+
+  private tasks: TileTask[] = [];
+
+  private queue: TileTask[] = [];
+
+  private attempts: Map<number, number> = new Map();
+
+  private done: Set<number> = new Set();
+
+  private total = 0;
+
+  private sums: Float32Array | null = null;
+
+  private current: {
+    width: number;
+    height: number;
+    camera: number[];
+    resolve: (image: Float32Array) => void;
+    reject: (error: Error) => void;
+    onProgress?: (done: number, total: number) => void;
+  } | null = null;
+
+  /**
+   * Creates an instance of TileCoordinator.
+   * @param {TileEndpoint[]} endpoints workers that called serveTiles
+   * @param {Partial<TileCoordinatorOptions>} [options={}]
+   * @memberof TileCoordinator
+   */
+  constructor(endpoints: TileEndpoint[], options: Partial<TileCoordinatorOptions> = {}) {
+    this.options = {
+      tileSize: 64,
+      samplesPerTask: 0,
+      timeoutMs: 0,
+      maxAttempts: 3,
+      ...options,
+    };
+    this.workers = endpoints.map((endpoint) => ({
+      endpoint,
+      task: null,
+      timer: null,
+      lost: false,
+    }));
+    this.workers.forEach((worker) => {
+      worker.endpoint.addEventListener('message', (event: MessageEvent) =>
+        this.onMessage(worker, event.data as TileResponse)
+      );
+      worker.endpoint.addEventListener('error', () => this.onLost(worker));
+    });
+  }
+
+  /**
+   * Render one frame on the workers.
+   * Resolves with width * height * 4 floats: mean linear [r, g, b] and the sample count.
+   * Starting another frame drops the results of the previous one.
+   *
+   * @param {Camera} camera
+   * @param {number} width
+   * @param {number} height
+   * @param {number} spp samples per pixel
+   * @param {(done: number, total: number) => void} [onProgress]
+   * @return {*}  {Promise<Float32Array>}
+   * @memberof TileCoordinator
+   */
+  public render(
+    camera: Camera,
+    width: number,
+    height: number,
+    spp: number,
+    onProgress?: (done: number, total: number) => void
+  ): Promise<Float32Array> {
+    if (this.current) this.current.reject(new Error('Frame was replaced by a new one.'));
+    this.frame += 1;
+    this.tasks = this.createTasks(width, height, spp);
+    this.queue = this.tasks.slice();
+    this.attempts = new Map();
+    this.done = new Set();
+    this.total = this.tasks.length;
+    this.sums = new Float32Array(width * height * 4);
+
+    return new Promise((resolve, reject) => {
+      this.current = { width, height, camera: camera.dumpAsArray(), resolve, reject, onProgress };
+      if (this.total === 0) {
+        this.finish();
+        return;
+      }
+      this.workers.forEach((worker) => {
+        if (!worker.task) this.dispatch(worker);
+      });
+      this.checkStalled();
+    });
+  }
+
+  private createTasks(width: number, height: number, spp: number) {
+    const { tileSize } = this.options;
+    const chunk = this.options.samplesPerTask > 0 ? this.options.samplesPerTask : spp;
+    const tasks: TileTask[] = [];
+    for (let y = 0; y < height; y += tileSize) {
+      for (let x = 0; x < width; x += tileSize) {
+        for (let s = 0; s < spp; s += chunk) {
+          const id = tasks.length;
+          tasks.push({
+            id,
+            frame: this.frame,
+            x,
+            y,
+            width: Math.min(tileSize, width - x),
+            height: Math.min(tileSize, height - y),
+            spp: Math.min(chunk, spp - s),
+            // 0x9e3779b1: golden ratio, spreads consecutive ids over the seed space
+            seed: (Math.imul(this.frame, 0x9e3779b1) ^ Math.imul(id + 1, 0x85ebca6b)) >>> 0,
+          });
+        }
+      }
+    }
+    return tasks;
+  }
+
+  private dispatch(worker: WorkerState) {
+    const state = worker;
+    if (!this.current || state.lost) return;
+    let task = this.queue.shift();
+    while (task && this.done.has(task.id)) task = this.queue.shift();
+    if (!task) return;
+
+    state.task = task;
+    if (this.options.timeoutMs > 0) {
+      state.timer = setTimeout(() => this.onTimeout(state), this.options.timeoutMs);
+    }
+    const request: TileRequest = {
+      type: 'tile',
+      task,
+      camera: this.current.camera,
+      frameWidth: this.current.width,
+      frameHeight: this.current.height,
+    };
+    state.endpoint.postMessage(request);
+  }
+
+  // put the task of the worker back to the queue (front, so it is retried soon)
+  private release(worker: WorkerState) {
+    const state = worker;
+    if (state.timer) clearTimeout(state.timer);
+    state.timer = null;
+    const { task } = state;
+    state.task = null;
+    if (!task || task.frame !== this.frame || this.done.has(task.id)) return;
+
+    const attempts = (this.attempts.get(task.id) ?? 0) + 1;
+    this.attempts.set(task.id, attempts);
+    if (attempts >= this.options.maxAttempts) {
+      this.fail(new Error(`Tile task ${task.id} failed ${attempts} times.`));
+      return;
+    }
+    this.queue.unshift(task);
+  }
+
+  private onLost(worker: WorkerState) {
+    const state = worker;
+    state.lost = true;
+    this.release(state);
+    this.workers.forEach((w) => {
+      if (!w.task) this.dispatch(w);
+    });
+    this.checkStalled();
+  }
+
+  // the worker may only be slow: reissue its task (counting an attempt) and keep using it,
+  // a late answer is merged if it comes first and dropped otherwise
+  private onTimeout(worker: WorkerState) {
+    const state = worker;
+    state.timer = null;
+    this.release(state);
+    this.workers.forEach((w) => {
+      if (!w.task) this.dispatch(w);
+    });
+  }
+
+  private onMessage(worker: WorkerState, response: TileResponse) {
+    const state = worker;
+    if (!response || (response.type !== 'tile-result' && response.type !== 'tile-error')) return;
+    // a worker that answers is alive again, even after a timeout
+    state.lost = false;
+
+    if (response.type === 'tile-error') {
+      if (state.task && state.task.id === response.id && state.task.frame === response.frame) {
+        this.release(state);
+      }
+    } else {
+      if (state.task && state.task.id === response.id && state.task.frame === response.frame) {
+        if (state.timer) clearTimeout(state.timer);
+        state.timer = null;
+        state.task = null;
+      }
+      if (response.frame === this.frame) this.merge(response.id, response.data);
+    }
+
+    if (!state.task) this.dispatch(state);
+    this.checkStalled();
+  }
+
+  private merge(id: number, data: Float32Array) {
+    if (!this.current || !this.sums || this.done.has(id)) return;
+    const task = this.tasks[id];
+    if (!task) return;
+    this.done.add(id);
+
+    const { sums } = this;
+    const { width } = this.current;
+    for (let j = 0; j < task.height; j += 1) {
+      for (let i = 0; i < task.width; i += 1) {
+        const src = (j * task.width + i) * 4;
+        const dst = ((task.y + j) * width + task.x + i) * 4;
+        sums[dst + 0] += data[src + 0];
+        sums[dst + 1] += data[src + 1];
+        sums[dst + 2] += data[src + 2];
+        sums[dst + 3] += data[src + 3];
+      }
+    }
+
+    if (this.current.onProgress) this.current.onProgress(this.done.size, this.total);
+    if (this.done.size === this.total) this.finish();
+  }
+
+  private finish() {
+    if (!this.current || !this.sums) return;
+    const image = this.sums;
+    for (let p = 0; p < image.length; p += 4) {
+      const n = image[p + 3];
+      if (n > 0) {
+        image[p + 0] /= n;
+        image[p + 1] /= n;
+        image[p + 2] /= n;
+      }
+    }
+    const { resolve } = this.current;
+    this.current = null;
+    this.sums = null;
+    this.tasks = [];
+    resolve(image);
+  }
+
+  private fail(error: Error) {
+    if (!this.current) return;
+    const { reject } = this.current;
+    this.current = null;
+    this.sums = null;
+    this.tasks = [];
+    this.queue = [];
+    reject(error);
+  }
+
+  // every worker has reported an error while tasks remain
+  private checkStalled() {
+    if (!this.current) return;
+    if (this.workers.every((worker) => worker.lost)) {
+      this.fail(new Error('All tile workers were lost.'));
+    }
+  }
+}
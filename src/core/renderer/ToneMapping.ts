@@ -0,0 +1,50 @@
+/**
+ * Curve applied to the exposed linear color before encoding.
+ * Values must match ToneCurve in src/wasm/raytracer/tonemap.hpp.
+ *
+ * @export
+ * @enum {number}
+ */
+export enum ToneCurve {
+  None = 0,
+  ACES = 1,
+  Filmic = 2,
+}
+
+/**
+ * Transfer function from linear color to 8 bit output.
+ * Values must match OutputEncoding in src/wasm/raytracer/tonemap.hpp.
+ *
+ * @export
+ * @enum {number}
+ */
+export enum OutputEncoding {
+  Gamma22 = 0,
+  SRGB = 1,
+}
+
+/**
+ * Encode linear RGB (3 floats per pixel, rows from the top) as a little-endian PFM file.
+ *
+ * @export
+ * @param {Float32Array} rgb
+ * @param {number} width
+ * @param {number} height
+ * @return {*}  {Uint8Array}
+ */
+export const encodePFM = (rgb: Float32Array, width: number, height: number): Uint8Array => {
+  // negative scale means little-endian
+  const header = new TextEncoder().encode(`PF\n${width} ${height}\n-1.0\n`);
+  const bytes = new Uint8Array(header.length + width * height * 12);
+  bytes.set(header, 0);
+  const view = new DataView(bytes.buffer, header.length);
+  // PFM stores rows from the bottom
+  for (let y = 0; y < height; y += 1) {
+    const src = (height - 1 - y) * width * 3;
+    const dst = y * width * 12;
+    for (let i = 0; i < width * 3; i += 1) {
+      view.setFloat32(dst + i * 4, rgb[src + i], true);
+    }
+  }
+  return bytes;
+};
@@ -39,6 +39,8 @@ export class Texture {
   }
 
   createBuffer(wasm: WasmManager, canvas: HTMLCanvasElement | OffscreenCanvas) {
+    // wasm keeps its own copy once the texture is created
+    if (this.id >= 0) return;
     if (this.needsUpdate) this.createPixelArray(canvas);
     if (this._buffer) return;
     this._buffer = wasm.createBuffer('i32', IMAGE_SIZE * IMAGE_SIZE * 4);
@@ -52,5 +54,6 @@ export class Texture {
 
   release() {
     this._buffer?.release();
+    this._buffer = null;
   }
 }
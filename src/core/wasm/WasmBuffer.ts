@@ -27,6 +27,10 @@ export class WasmBuffer {
     return this._type;
   }
 
+  get byteLength() {
+    return this._length * this._stride;
+  }
+
   /**
    * Creates an instance of WasmBuffer.
    * @param {WasmModule} module
@@ -82,7 +86,37 @@ export class WasmBuffer {
    * @memberof WasmBuffer
    */
   public setArray(array: WasmArrayType | Array<number>) {
-    array.forEach((value, index) => this.set(index, value));
+    // copy whole array through heap view (values are converted to buffer type)
+    if (this.type === 'i32') this._module.HEAP32.set(array, this._base >> 2);
+    else if (this.type === 'float') this._module.HEAPF32.set(array, this._base >> 2);
+    else if (this.type === 'double') this._module.HEAPF64.set(array, this._base >> 3);
+    else array.forEach((value, index) => this.set(index, value));
+  }
+
+  /**
+   * Copy buffer to a new typed array
+   *
+   * @return {*}  {(Int32Array | Float32Array | Float64Array)}
+   * @memberof WasmBuffer
+   */
+  public getArray(): Int32Array | Float32Array | Float64Array {
+    if (this.type === 'i32') return this._module.HEAP32.slice(this._base >> 2, (this._base >> 2) + this._length);
+    if (this.type === 'float') return this._module.HEAPF32.slice(this._base >> 2, (this._base >> 2) + this._length);
+    if (this.type === 'double') return this._module.HEAPF64.slice(this._base >> 3, (this._base >> 3) + this._length);
+    const array = new Float64Array(this._length);
+    for (let i = 0; i < array.length; i += 1) array[i] = this.get(i);
+    return array;
+  }
+
+  /**
+   * Copy raw bytes to buffer
+   *
+   * @param {Uint8Array} bytes
+   * @param {number} [byteOffset=0] destination offset in bytes
+   * @memberof WasmBuffer
+   */
+  public setBytes(bytes: Uint8Array, byteOffset: number = 0) {
+    this._module.HEAPU8.set(bytes, this._base + byteOffset);
   }
 
   /**
@@ -1,4 +1,4 @@
-import { WasmValueType } from '../../types/wasm';
+import { MemoryUsage, RenderStats, WasmValueType } from '../../types/wasm';
 import { WasmBuffer } from './WasmBuffer';
 import { WasmModuleGenerator } from './WasmModule';
 
@@ -49,6 +49,10 @@ export class WasmManager extends EventTarget {
     return this.callFunction('createBounding', ...args);
   }
 
+  public callCreateMeshes(...args: (number | WasmBuffer)[]) {
+    return this.callFunction('createMeshes', ...args);
+  }
+
   public callSetCamera(...args: (number | WasmBuffer)[]) {
     return this.callFunction('setCamera', ...args);
   }
@@ -57,6 +61,149 @@ export class WasmManager extends EventTarget {
     return this.callFunction('readStream', ...args);
   }
 
+  public callReadStreamFor(...args: (number | WasmBuffer)[]) {
+    return this.callFunction('readStreamFor', ...args);
+  }
+
+  public callSetSamplesPerPixel(...args: (number | WasmBuffer)[]) {
+    return this.callFunction('setSamplesPerPixel', ...args);
+  }
+
+  public callSetDenoise(...args: (number | WasmBuffer)[]) {
+    return this.callFunction('setDenoise', ...args);
+  }
+
+  public callSetAOVs(...args: (number | WasmBuffer)[]) {
+    return this.callFunction('setAOVs', ...args);
+  }
+
+  public callSetToneMapping(...args: (number | WasmBuffer)[]) {
+    return this.callFunction('setToneMapping', ...args);
+  }
+
+  public callApplyToneMapping(...args: (number | WasmBuffer)[]) {
+    return this.callFunction('applyToneMapping', ...args);
+  }
+
+  public callGetHDR(...args: (number | WasmBuffer)[]) {
+    return this.callFunction('getHDR', ...args);
+  }
+
+  /**
+   * Float32Array over wasm memory without copying.
+   * It is detached when the wasm memory grows.
+   *
+   * @param {number} pointer byte address
+   * @param {number} length number of floats
+   * @return {*}  {Float32Array}
+   * @memberof WasmManager
+   */
+  public viewFloat32(pointer: number, length: number): Float32Array {
+    return new Float32Array(this.module.HEAPF32.buffer, pointer, length);
+  }
+
+  public callSetBVHCompression(...args: (number | WasmBuffer)[]) {
+    return this.callFunction('setBVHCompression', ...args);
+  }
+
+  public callSetBVHSpatialSplits(...args: (number | WasmBuffer)[]) {
+    return this.callFunction('setBVHSpatialSplits', ...args);
+  }
+
+  public callSetRayBatching(...args: (number | WasmBuffer)[]) {
+    return this.callFunction('setRayBatching', ...args);
+  }
+
+  public callSetRasterization(...args: (number | WasmBuffer)[]) {
+    return this.callFunction('setRasterization', ...args);
+  }
+
+  public callSetModelTransform(...args: (number | WasmBuffer)[]) {
+    return this.callFunction('setModelTransform', ...args);
+  }
+
+  public callSetModelMaterial(...args: (number | WasmBuffer)[]) {
+    return this.callFunction('setModelMaterial', ...args);
+  }
+
+  public callRenderRegion(...args: (number | WasmBuffer)[]) {
+    return this.callFunction('renderRegion', ...args);
+  }
+
+  public callCreateCheckpoint() {
+    return this.callFunction('createCheckpoint');
+  }
+
+  public callCopyCheckpoint(...args: (number | WasmBuffer)[]) {
+    return this.callFunction('copyCheckpoint', ...args);
+  }
+
+  public callLoadCheckpoint(...args: (number | WasmBuffer)[]) {
+    return this.callFunction('loadCheckpoint', ...args);
+  }
+
+  public callSetPreview(...args: (number | WasmBuffer)[]) {
+    return this.callFunction('setPreview', ...args);
+  }
+
+  public callSetRadianceCache(...args: (number | WasmBuffer)[]) {
+    return this.callFunction('setRadianceCache', ...args);
+  }
+
+  public callSetPathGuiding(...args: (number | WasmBuffer)[]) {
+    return this.callFunction('setPathGuiding', ...args);
+  }
+
+  public callGetAOV(...args: (number | WasmBuffer)[]) {
+    return this.callFunction('getAOV', ...args);
+  }
+
+  /**
+   * Call getStats function in wasm and decode returned JSON
+   *
+   * @return {*}  {RenderStats}
+   * @memberof WasmManager
+   */
+  public callGetStats(): RenderStats {
+    const pointer = this.callFunction('getStats');
+    return JSON.parse(this.module.UTF8ToString(pointer));
+  }
+
+  /**
+   * Call getMemoryUsage function in wasm and decode returned JSON
+   *
+   * @return {*}  {MemoryUsage}
+   * @memberof WasmManager
+   */
+  public callGetMemoryUsage(): MemoryUsage {
+    const pointer = this.callFunction('getMemoryUsage');
+    return JSON.parse(this.module.UTF8ToString(pointer));
+  }
+
+  public callSetMemoryBudget(...args: (number | WasmBuffer)[]) {
+    return this.callFunction('setMemoryBudget', ...args);
+  }
+
+  public callIntersectRays(...args: (number | WasmBuffer)[]) {
+    return this.callFunction('intersectRays', ...args);
+  }
+
+  public callSetLightmapTarget(...args: (number | WasmBuffer)[]) {
+    return this.callFunction('setLightmapTarget', ...args);
+  }
+
+  public callBakeLightmap(...args: (number | WasmBuffer)[]) {
+    return this.callFunction('bakeLightmap', ...args);
+  }
+
+  public callReadLightmap(...args: (number | WasmBuffer)[]) {
+    return this.callFunction('readLightmap', ...args);
+  }
+
+  public callOccludedRays(...args: (number | WasmBuffer)[]) {
+    return this.callFunction('occludedRays', ...args);
+  }
+
   public callFunction(funcname: string, ...args: (number | WasmBuffer)[]) {
     const rawArgs = args.map((v) => (v instanceof WasmBuffer ? v.getPointer() : v));
     const argTypes = args.map((v) => (v instanceof WasmBuffer ? 'pointer' : 'number'));
@@ -31,6 +31,26 @@ export interface WasmModule {
    */
   getValue(pointer: number, type: WasmValueType): number;
 
+  /**
+   * Views of wasm heap (replaced when memory grows, so do not cache them)
+   *
+   * @memberof WasmModule
+   */
+  HEAPU8: Uint8Array;
+
+  HEAP32: Int32Array;
+
+  HEAPF32: Float32Array;
+
+  HEAPF64: Float64Array;
+
+  /**
+   * Read null-terminated UTF-8 string from pointer
+   *
+   * @memberof WasmModule
+   */
+  UTF8ToString(pointer: number): string;
+
   /**
    * Path tracer function
    *
@@ -59,6 +79,216 @@ export interface WasmModule {
    */
   _readStream(...args: number[]): number;
 
+  /**
+   * Create multiple meshes in one call
+   *
+   * @memberof WasmRawModule
+   */
+  _createMeshes(...args: number[]): number;
+
+  /**
+   * load pixel data within time budget
+   *
+   * @memberof WasmRawModule
+   */
+  _readStreamFor(...args: number[]): number;
+
+  /**
+   * Set samples per pixel
+   *
+   * @memberof WasmRawModule
+   */
+  _setSamplesPerPixel(...args: number[]): number;
+
+  /**
+   * Enable or disable denoiser
+   *
+   * @memberof WasmRawModule
+   */
+  _setDenoise(...args: number[]): number;
+
+  /**
+   * Enable or disable writing AOVs while rendering
+   *
+   * @memberof WasmRawModule
+   */
+  _setAOVs(...args: number[]): number;
+
+  /**
+   * Set exposure, tone curve, output encoding and dithering
+   *
+   * @memberof WasmRawModule
+   */
+  _setToneMapping(...args: number[]): number;
+
+  /**
+   * Tone map the last finished HDR image again into a pixel buffer
+   *
+   * @memberof WasmRawModule
+   */
+  _applyToneMapping(...args: number[]): number;
+
+  /**
+   * Get pointer to the last finished HDR image and write its size
+   *
+   * @memberof WasmRawModule
+   */
+  _getHDR(...args: number[]): number;
+
+  /**
+   * Quantize BVH nodes to 8 or 16 bits (0 disables)
+   *
+   * @memberof WasmRawModule
+   */
+  _setBVHCompression(...args: number[]): number;
+
+  /**
+   * Trace paths of a tile together (0: per pixel, 1: batch, 2: batch with ray sorting)
+   *
+   * @memberof WasmRawModule
+   */
+  _setRayBatching(...args: number[]): number;
+
+  /**
+   * Build BVH of following meshes with spatial splits
+   *
+   * @memberof WasmRawModule
+   */
+  _setBVHSpatialSplits(...args: number[]): number;
+
+  /**
+   * Copy AOV buffer of last render
+   *
+   * @memberof WasmRawModule
+   */
+  _getAOV(...args: number[]): number;
+
+  /**
+   * Get rendering statistics as JSON string pointer
+   *
+   * @memberof WasmRawModule
+   */
+  _getStats(): number;
+
+  /**
+   * Get memory usage as JSON string pointer
+   *
+   * @memberof WasmRawModule
+   */
+  _getMemoryUsage(): number;
+
+  /**
+   * Set memory budget in megabytes (0 is unlimited)
+   *
+   * @memberof WasmRawModule
+   */
+  _setMemoryBudget(...args: number[]): number;
+
+  /**
+   * Find closest hits of a batch of rays
+   *
+   * @memberof WasmRawModule
+   */
+  _intersectRays(...args: number[]): number;
+
+  /**
+   * Enable rasterized primary visibility
+   *
+   * @memberof WasmRawModule
+   */
+  _setRasterization(...args: number[]): number;
+
+  /**
+   * Replace transform of a model
+   *
+   * @memberof WasmRawModule
+   */
+  _setModelTransform(...args: number[]): number;
+
+  /**
+   * Replace material of a model
+   *
+   * @memberof WasmRawModule
+   */
+  _setModelMaterial(...args: number[]): number;
+
+  /**
+   * Render a region of the frame with a fixed seed
+   *
+   * @memberof WasmRawModule
+   */
+  _renderRegion(...args: number[]): number;
+
+  /**
+   * Serialize render state to an internal buffer and return its size
+   *
+   * @memberof WasmRawModule
+   */
+  _createCheckpoint(): number;
+
+  /**
+   * Copy serialized render state
+   *
+   * @memberof WasmRawModule
+   */
+  _copyCheckpoint(...args: number[]): number;
+
+  /**
+   * Restore serialized render state
+   *
+   * @memberof WasmRawModule
+   */
+  _loadCheckpoint(...args: number[]): number;
+
+  /**
+   * Set scale of the preview at the start of a restarted render
+   *
+   * @memberof WasmRawModule
+   */
+  _setPreview(...args: number[]): number;
+
+  /**
+   * Configure radiance cache
+   *
+   * @memberof WasmRawModule
+   */
+  _setRadianceCache(...args: number[]): number;
+
+  /**
+   * Configure path guiding
+   *
+   * @memberof WasmRawModule
+   */
+  _setPathGuiding(...args: number[]): number;
+
+  /**
+   * Set mesh and second UV set to bake a lightmap
+   *
+   * @memberof WasmRawModule
+   */
+  _setLightmapTarget(...args: number[]): number;
+
+  /**
+   * Add samples to the lightmap
+   *
+   * @memberof WasmRawModule
+   */
+  _bakeLightmap(...args: number[]): number;
+
+  /**
+   * Read averaged and dilated lightmap
+   *
+   * @memberof WasmRawModule
+   */
+  _readLightmap(...args: number[]): number;
+
+  /**
+   * Test occlusion of a batch of rays
+   *
+   * @memberof WasmRawModule
+   */
+  _occludedRays(...args: number[]): number;
+
   /**
    * call wasm function
    *
@@ -860,6 +860,96 @@ const WasmModuleGenerator = () => {
     let _pathTracer = Module._pathTracer = function() {
         return (_pathTracer = Module._pathTracer = Module.asm.pathTracer).apply(null, arguments)
     };
+    let _setDenoise = Module._setDenoise = function() {
+        return (_setDenoise = Module._setDenoise = Module.asm.setDenoise).apply(null, arguments)
+    };
+    let _getAOV = Module._getAOV = function() {
+        return (_getAOV = Module._getAOV = Module.asm.getAOV).apply(null, arguments)
+    };
+    let _getStats = Module._getStats = function() {
+        return (_getStats = Module._getStats = Module.asm.getStats).apply(null, arguments)
+    };
+    let _setSamplesPerPixel = Module._setSamplesPerPixel = function() {
+        return (_setSamplesPerPixel = Module._setSamplesPerPixel = Module.asm.setSamplesPerPixel).apply(null, arguments)
+    };
+    let _readStreamFor = Module._readStreamFor = function() {
+        return (_readStreamFor = Module._readStreamFor = Module.asm.readStreamFor).apply(null, arguments)
+    };
+    let _createMeshes = Module._createMeshes = function() {
+        return (_createMeshes = Module._createMeshes = Module.asm.createMeshes).apply(null, arguments)
+    };
+    let _setBVHCompression = Module._setBVHCompression = function() {
+        return (_setBVHCompression = Module._setBVHCompression = Module.asm.setBVHCompression).apply(null, arguments)
+    };
+    let _setBVHSpatialSplits = Module._setBVHSpatialSplits = function() {
+        return (_setBVHSpatialSplits = Module._setBVHSpatialSplits = Module.asm.setBVHSpatialSplits).apply(null, arguments)
+    };
+    let _setMemoryBudget = Module._setMemoryBudget = function() {
+        return (_setMemoryBudget = Module._setMemoryBudget = Module.asm.setMemoryBudget).apply(null, arguments)
+    };
+    let _getMemoryUsage = Module._getMemoryUsage = function() {
+        return (_getMemoryUsage = Module._getMemoryUsage = Module.asm.getMemoryUsage).apply(null, arguments)
+    };
+    let _setRayBatching = Module._setRayBatching = function() {
+        return (_setRayBatching = Module._setRayBatching = Module.asm.setRayBatching).apply(null, arguments)
+    };
+    let _intersectRays = Module._intersectRays = function() {
+        return (_intersectRays = Module._intersectRays = Module.asm.intersectRays).apply(null, arguments)
+    };
+    let _occludedRays = Module._occludedRays = function() {
+        return (_occludedRays = Module._occludedRays = Module.asm.occludedRays).apply(null, arguments)
+    };
+    let _setLightmapTarget = Module._setLightmapTarget = function() {
+        return (_setLightmapTarget = Module._setLightmapTarget = Module.asm.setLightmapTarget).apply(null, arguments)
+    };
+    let _bakeLightmap = Module._bakeLightmap = function() {
+        return (_bakeLightmap = Module._bakeLightmap = Module.asm.bakeLightmap).apply(null, arguments)
+    };
+    let _readLightmap = Module._readLightmap = function() {
+        return (_readLightmap = Module._readLightmap = Module.asm.readLightmap).apply(null, arguments)
+    };
+    let _setRasterization = Module._setRasterization = function() {
+        return (_setRasterization = Module._setRasterization = Module.asm.setRasterization).apply(null, arguments)
+    };
+    let _setRadianceCache = Module._setRadianceCache = function() {
+        return (_setRadianceCache = Module._setRadianceCache = Module.asm.setRadianceCache).apply(null, arguments)
+    };
+    let _setPathGuiding = Module._setPathGuiding = function() {
+        return (_setPathGuiding = Module._setPathGuiding = Module.asm.setPathGuiding).apply(null, arguments)
+    };
+    let _setPreview = Module._setPreview = function() {
+        return (_setPreview = Module._setPreview = Module.asm.setPreview).apply(null, arguments)
+    };
+    let _setModelTransform = Module._setModelTransform = function() {
+        return (_setModelTransform = Module._setModelTransform = Module.asm.setModelTransform).apply(null, arguments)
+    };
+    let _setModelMaterial = Module._setModelMaterial = function() {
+        return (_setModelMaterial = Module._setModelMaterial = Module.asm.setModelMaterial).apply(null, arguments)
+    };
+    let _createCheckpoint = Module._createCheckpoint = function() {
+        return (_createCheckpoint = Module._createCheckpoint = Module.asm.createCheckpoint).apply(null, arguments)
+    };
+    let _copyCheckpoint = Module._copyCheckpoint = function() {
+        return (_copyCheckpoint = Module._copyCheckpoint = Module.asm.copyCheckpoint).apply(null, arguments)
+    };
+    let _loadCheckpoint = Module._loadCheckpoint = function() {
+        return (_loadCheckpoint = Module._loadCheckpoint = Module.asm.loadCheckpoint).apply(null, arguments)
+    };
+    let _renderRegion = Module._renderRegion = function() {
+        return (_renderRegion = Module._renderRegion = Module.asm.renderRegion).apply(null, arguments)
+    };
+    let _setAOVs = Module._setAOVs = function() {
+        return (_setAOVs = Module._setAOVs = Module.asm.setAOVs).apply(null, arguments)
+    };
+    let _setToneMapping = Module._setToneMapping = function() {
+        return (_setToneMapping = Module._setToneMapping = Module.asm.setToneMapping).apply(null, arguments)
+    };
+    let _applyToneMapping = Module._applyToneMapping = function() {
+        return (_applyToneMapping = Module._applyToneMapping = Module.asm.applyToneMapping).apply(null, arguments)
+    };
+    let _getHDR = Module._getHDR = function() {
+        return (_getHDR = Module._getHDR = Module.asm.getHDR).apply(null, arguments)
+    };
     let ___errno_location = Module.___errno_location = function() {
         return (___errno_location = Module.___errno_location = Module.asm.__errno_location).apply(null, arguments)
     };
@@ -884,6 +974,7 @@ const WasmModuleGenerator = () => {
     Module.ccall = ccall;
     Module.setValue = setValue;
     Module.getValue = getValue;
+    Module.UTF8ToString = UTF8ToString;
     let calledRun;
 
     function ExitStatus(status) {
@@ -1,6 +1,10 @@
 export * from './core/renderer/Renderer';
+export * from './core/renderer/AOV';
+export * from './core/renderer/ToneMapping';
+export * from './core/renderer/TileCoordinator';
 export * from './core/model/Model';
 export * from './core/model/GLTFLoader';
+export * from './core/model/GLTFScene';
 export * from './core/model/Transform';
 export * from './core/material/Material';
 export * from './core/material/Glass';
@@ -9,6 +9,7 @@ export interface GLTFJsonNode {
   scale?: number[];
   translation?: number[];
   meshes: number[] | string[];
+  mesh?: number;
   camera: number | string;
   name: string;
 }
@@ -23,11 +24,16 @@ export interface GLTFJsonMesh {
       [key: string]: number | string;
     };
     indices: number | string;
+    material?: number;
+    mode?: number;
   }[];
 }
 
 export interface GLTFJsonAccessor {
   bufferView: number | string;
+  byteOffset?: number;
+  componentType: number;
+  normalized?: boolean;
   max?: number[];
   min?: number[];
   type: string;
@@ -38,6 +44,14 @@ export interface GLTFJsonBufferView {
   buffer: number | string;
   byteLength: number;
   byteOffset: number;
+  byteStride?: number;
+}
+
+export interface GLTFJsonMaterial {
+  name?: string;
+  pbrMetallicRoughness?: {
+    baseColorFactor?: number[];
+  };
 }
 
 export interface GLTFJsonBuffer {
@@ -60,4 +74,5 @@ export interface GLTFJson {
   accessors: GLTFJsonAccessor[] | { [key: string]: GLTFJsonAccessor };
   bufferViews: GLTFJsonBufferView[] | { [key: string]: GLTFJsonBufferView };
   buffers: GLTFJsonBuffer[] | { [key: string]: GLTFJsonBuffer };
+  materials?: GLTFJsonMaterial[];
 }
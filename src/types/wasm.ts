@@ -11,3 +11,61 @@ export type WasmArrayType =
   | Uint8ClampedArray
   | Float32Array
   | Float64Array;
+
+/**
+ * Rendering statistics (collected only when wasm is built with -DRAYTRACER_STATS)
+ */
+export interface RenderStats {
+  enabled: boolean;
+  rays: { camera: number; bounce: number; shadow: number };
+  nodeVisits: number;
+  triangleTests: number;
+  paths: number;
+  averagePathLength: number;
+  rouletteTerminations: number;
+  scene: {
+    triangles: number;
+    references: number;
+    geometryBytes: number;
+    bvhNodeBytes: number;
+    bvhNodeBits: number;
+  };
+  tiles: { x: number; y: number; width: number; height: number; ms: number }[];
+}
+
+/**
+ * Closest hits of a batch of rays. Missed rays have t = -1 and model = prim = -1
+ */
+export interface RayHits {
+  count: number;
+  t: Float32Array;
+  u: Float32Array;
+  v: Float32Array;
+  model: Int32Array;
+  prim: Int32Array;
+}
+
+/**
+ * Rectangle of the frame in pixels
+ */
+export interface TileRegion {
+  x: number;
+  y: number;
+  width: number;
+  height: number;
+}
+
+/**
+ * Memory used by each part of the renderer in bytes
+ */
+export interface MemoryUsage {
+  geometry: number;
+  bvhNodes: number;
+  textures: number;
+  framebuffers: number;
+  scratch: number;
+  caches: number;
+  total: number;
+  heap: number;
+  budget: number;
+}
@@ -1,15 +1,42 @@
 #ifndef BVH_HPP
 #define BVH_HPP
 
+#include <cstdint>
+#include <limits>
 #include "simpleIntersect.hpp"
-
-#define MINIMUM_INTERSECT_DISTANCE_2 0.0000001
-
-struct vert{
-    point3 point;
-    vec3 norm;
-    texpoint texcoord;
-};
+#include "stats.hpp"
+#include "meshopt.hpp"
+#include "memory.hpp"
+
+//自己交差を避けるため、これより近い交差は無視する
+#define MINIMUM_INTERSECT_DISTANCE 0.0003
+
+//SBVHでSAHを評価するときのビンの数
+#define SBVH_BINS 16
+//物体分割の2つの子の重なりが、根の表面積のこの割合より大きいときだけ空間分割を試す
+#define SBVH_ALPHA 1e-5
+
+//親の箱[m,M]をQ等分した格子のq番目の座標(両端はm,Mそのもの)
+//量子化するときと復元するときで同じ式を使うので、丸めの向きがずれない
+inline double dequantize(double m,double M,int q,int Q){
+    if(q<=0)return m;
+    if(q>=Q)return M;
+    return m + (M-m)*q/Q;
+}
+
+//cを下回らない(upperなら上回らない)ように保守的に丸めた格子番号を返す
+inline int quantize(double m,double M,double c,int Q,bool upper){
+    if(!(M>m))return upper ? Q : 0;
+    double f = (c-m)/(M-m)*Q;
+    int q = upper ? (int)std::ceil(f) : (int)std::floor(f);
+    q = std::max(0,std::min(Q,q));
+    if(upper){
+        while(q<Q && dequantize(m,M,q,Q)<c)q++;
+    }else{
+        while(q>0 && dequantize(m,M,q,Q)>c)q--;
+    }
+    return q;
+}
 
 //モデルにBVHを与える関数のクラス
 class ModelBVH {
@@ -23,306 +50,720 @@ class ModelBVH {
         bool isLeaf; //葉ならtrue、子を持つならfalse
         std::array<int,2> children; //子頂点のインデックス
         std::array<int,3> triangle; //葉が持っている三角形
+        int prim; //葉が持っている三角形の元のポリゴン番号
+        int first; //葉が持っている三角形のTriangles上の位置
+    };
+
+    //圧縮したBVHの内部ノード
+    //2つの子の箱を、このノードの箱をTの最大値で等分した格子上に外側へ丸めて持つ
+    //子が葉なら~(Triangles上の位置)を持つ
+    template<typename T>
+    struct QuantizedBVH{
+        std::array<T,3> lo[2],hi[2];
+        std::array<int,2> children;
+    };
+
+    //軸に平行な箱(空なら m > M)
+    struct Bounds{
+        point3 m = {INFF,INFF,INFF}, M = {-INFF,-INFF,-INFF};
+
+        bool valid() const {
+            return m.x<=M.x && m.y<=M.y && m.z<=M.z;
+        }
+        void grow(const point3& p){
+            m = {std::min(m.x,p.x),std::min(m.y,p.y),std::min(m.z,p.z)};
+            M = {std::max(M.x,p.x),std::max(M.y,p.y),std::max(M.z,p.z)};
+        }
+        void grow(const Bounds& b){
+            if(!b.valid())return;
+            grow(b.m);
+            grow(b.M);
+        }
+        Bounds clip(const Bounds& b) const {
+            Bounds r;
+            r.m = {std::max(m.x,b.m.x),std::max(m.y,b.m.y),std::max(m.z,b.m.z)};
+            r.M = {std::min(M.x,b.M.x),std::min(M.y,b.M.y),std::min(M.z,b.M.z)};
+            return r;
+        }
+        double area() const {
+            if(!valid())return 0;
+            double x = M.x-m.x, y = M.y-m.y, z = M.z-m.z;
+            return 2.0*(x*y+y*z+z*x);
+        }
+    };
+
+    //SBVHで使う三角形の参照。空間分割で切られた参照は、三角形のその部分だけを囲む箱を持つ
+    struct Reference{
+        int poly;
+        Bounds box;
+    };
+
+    //交差判定用に頂点座標を展開した三角形(葉の順に並べる)
+    struct TriangleRecord{
+        point3 v0,v1,v2;
     };
 
     std::vector<vert> Vertex;
+    std::vector<std::array<int,3>> Polygon;
     std::vector<BVH> Node;
+    std::vector<TriangleRecord> Triangles;
+    std::vector<std::array<int,3>> LeafTriangle; //Triangles[i]の頂点番号
+    std::vector<int> LeafPrim; //Triangles[i]の元のポリゴン番号
+    int PolygonCount = 0;
+    double RootArea = 0; //SBVHの構築中だけ使う
+
+    //圧縮形式(nodeBitsが0ならNodeをそのまま使う)
+    int nodeBits = 0;
+    std::vector<QuantizedBVH<uint8_t>> Node8;
+    std::vector<QuantizedBVH<uint16_t>> Node16;
+    point3 RootBox_m,RootBox_M; //根の箱だけはそのまま持つ
+    int Root = 0;
+
+    //polygon[0..V)のポリゴンでindex番目のノードを作る
+    //子に分けるときはpolygonをその場で並べ替える(左の子が前、右の子が後ろ)ので、リストを作り直さない
+    //重心や並べ替えの作業用配列はarenaから取り、子に潜る前に戻す
+    void construct_BVH_internal(int* polygon,int V,int index,Arena& arena){
 
-    void construct_BVH_internal(std::vector<std::array<int,3>> polygon,int index){
-
-        int V = polygon.size();
         if(V<=0){return;}
         if(V==1){
             //ポリゴンが1個しかないならここを葉ノードにする
             point3 P={INFF,INFF,INFF},Q = {-INFF,-INFF,-INFF};
             for(int j=0;j<3;j++){
-                P.x = std::min(P.x,Vertex[polygon[0][j]].point.x);
-                P.y = std::min(P.y,Vertex[polygon[0][j]].point.y);
-                P.z = std::min(P.z,Vertex[polygon[0][j]].point.z);
-                Q.x = std::max(Q.x,Vertex[polygon[0][j]].point.x);
-                Q.y = std::max(Q.y,Vertex[polygon[0][j]].point.y);
-                Q.z = std::max(Q.z,Vertex[polygon[0][j]].point.z);
+                P.x = std::min(P.x,Vertex[Polygon[polygon[0]][j]].point.x);
+                P.y = std::min(P.y,Vertex[Polygon[polygon[0]][j]].point.y);
+                P.z = std::min(P.z,Vertex[Polygon[polygon[0]][j]].point.z);
+                Q.x = std::max(Q.x,Vertex[Polygon[polygon[0]][j]].point.x);
+                Q.y = std::max(Q.y,Vertex[Polygon[polygon[0]][j]].point.y);
+                Q.z = std::max(Q.z,Vertex[Polygon[polygon[0]][j]].point.z);
             }
 
             BVH bvh;
             bvh.Box_m = P;
             bvh.Box_M = Q;
             bvh.isLeaf = true;
-            bvh.triangle = polygon[0];
+            bvh.triangle = Polygon[polygon[0]];
+            bvh.prim = polygon[0];
             
             Node[index] = bvh;
             return ;
         }
 
+        Arena::Marker marker = arena.mark();
+        double* coor = arena.make<double>(V);
+        auto centroid = [&](int poly,int axis){
+            return (axisOf(Vertex[Polygon[poly][0]].point,axis)+axisOf(Vertex[Polygon[poly][1]].point,axis)+axisOf(Vertex[Polygon[poly][2]].point,axis))/3.0;
+        };
+
         //ポリゴンの重心の座標をもとに、ポリゴンの数が均等になるように大きく2つに分ける
+        //X,Y,Zの各軸について、分けたときの2つの箱の表面積の和と、分け方の偏りを求める
         //TODO:重心が同じ2つのポリゴンが存在すると死にます
-
-        //X軸
-        std::vector<double> coor(V);
-        for(int i=0;i<V;i++){
-            coor[i] = (Vertex[polygon[i][0]].point.x+Vertex[polygon[i][1]].point.x+Vertex[polygon[i][2]].point.x)/3.0;
+        double med[3],sur[3];
+        int count[3];
+        for(int axis=0;axis<3;axis++){
+            for(int i=0;i<V;i++){
+                coor[i] = centroid(polygon[i],axis);
+            }
+            std::sort(coor,coor+V);
+            med[axis] = coor[V/2];
+            if(V%2==0)med[axis] = (coor[V/2]+coor[(V-1)/2])/2.0;
+
+            int n1 = 0;
+            point3 p1={INFF,INFF,INFF},q1 = {-INFF,-INFF,-INFF},p2={INFF,INFF,INFF},q2 = {-INFF,-INFF,-INFF};
+            for(int i=0;i<V;i++){
+                bool left = centroid(polygon[i],axis) < med[axis];
+                if(left)n1++;
+                point3 &p = left ? p1 : p2,&q = left ? q1 : q2;
+                for(int j=0;j<3;j++){
+                    p.x = std::min(p.x,Vertex[Polygon[polygon[i]][j]].point.x);
+                    p.y = std::min(p.y,Vertex[Polygon[polygon[i]][j]].point.y);
+                    p.z = std::min(p.z,Vertex[Polygon[polygon[i]][j]].point.z);
+                    q.x = std::max(q.x,Vertex[Polygon[polygon[i]][j]].point.x);
+                    q.y = std::max(q.y,Vertex[Polygon[polygon[i]][j]].point.y);
+                    q.z = std::max(q.z,Vertex[Polygon[polygon[i]][j]].point.z);
+                }
+            }
+            count[axis] = n1;
+            sur[axis] = 2.0*((q1.y-p1.y)*(q1.z-p1.z)+(q1.z-p1.z)*(q1.x-p1.x)+(q1.x-p1.x)*(q1.y-p1.y))
+                        + 2.0*((q2.y-p2.y)*(q2.z-p2.z)+(q2.z-p2.z)*(q2.x-p2.x)+(q2.x-p2.x)*(q2.y-p2.y));
+            if(n1==0 || n1==V){
+                sur[axis] = INFF;
+            }
         }
-        std::sort(coor.begin(),coor.end());
-        double med = coor[V/2];
-        if(V%2==0)med = (coor[V/2]+coor[(V-1)/2])/2.0;
 
-        std::vector<std::array<int,3>> poly_x[2];
-        point3 p1={INFF,INFF,INFF},q1 = {-INFF,-INFF,-INFF},p2={INFF,INFF,INFF},q2 = {-INFF,-INFF,-INFF};
+        //３つの軸で、その軸を基準に分解したときの分解の仕方とその表面積が計算できた
+        //分解の均等さ<表面積の小ささで採用する軸を決定する
+        //２つに分けたものをそれぞれ次のBVH計算に与える
+        point3 P={INFF,INFF,INFF},Q = {-INFF,-INFF,-INFF};
         for(int i=0;i<V;i++){
-            if((Vertex[polygon[i][0]].point.x+Vertex[polygon[i][1]].point.x+Vertex[polygon[i][2]].point.x)/3.0 < med){
-                poly_x[0].push_back(polygon[i]);
-                for(int j=0;j<3;j++){
-                    p1.x = std::min(p1.x,Vertex[polygon[i][j]].point.x);
-                    p1.y = std::min(p1.y,Vertex[polygon[i][j]].point.y);
-                    p1.z = std::min(p1.z,Vertex[polygon[i][j]].point.z);
-                    q1.x = std::max(q1.x,Vertex[polygon[i][j]].point.x);
-                    q1.y = std::max(q1.y,Vertex[polygon[i][j]].point.y);
-                    q1.z = std::max(q1.z,Vertex[polygon[i][j]].point.z);
-                }
-            }else{
-                poly_x[1].push_back(polygon[i]);
-                for(int j=0;j<3;j++){
-                    p2.x = std::min(p2.x,Vertex[polygon[i][j]].point.x);
-                    p2.y = std::min(p2.y,Vertex[polygon[i][j]].point.y);
-                    p2.z = std::min(p2.z,Vertex[polygon[i][j]].point.z);
-                    q2.x = std::max(q2.x,Vertex[polygon[i][j]].point.x);
-                    q2.y = std::max(q2.y,Vertex[polygon[i][j]].point.y);
-                    q2.z = std::max(q2.z,Vertex[polygon[i][j]].point.z);
-                }
-                
+            for(int j=0;j<3;j++){
+                P.x = std::min(P.x,Vertex[Polygon[polygon[i]][j]].point.x);
+                P.y = std::min(P.y,Vertex[Polygon[polygon[i]][j]].point.y);
+                P.z = std::min(P.z,Vertex[Polygon[polygon[i]][j]].point.z);
+                Q.x = std::max(Q.x,Vertex[Polygon[polygon[i]][j]].point.x);
+                Q.y = std::max(Q.y,Vertex[Polygon[polygon[i]][j]].point.y);
+                Q.z = std::max(Q.z,Vertex[Polygon[polygon[i]][j]].point.z);
             }
         }
 
-        double surx = 2.0*((q1.y-p1.y)*(q1.z-p1.z)+(q1.z-p1.z)*(q1.x-p1.x)+(q1.x-p1.x)*(q1.y-p1.y))
-                        + 2.0*((q2.y-p2.y)*(q2.z-p2.z)+(q2.z-p2.z)*(q2.x-p2.x)+(q2.x-p2.x)*(q2.y-p2.y));
-        if(poly_x[0].empty() || poly_x[1].empty()){
-            surx = INFF;
+        BVH bvh;
+        bvh.Box_m = P;
+        bvh.Box_M = Q;
+        bvh.isLeaf = false;
+
+        int n = Node.size();
+        Node.resize(n+2);
+        bvh.children[0] = n;
+        bvh.children[1] = n+1;
+
+        Node[index] = bvh;
+
+        assert(std::min({sur[0],sur[1],sur[2]})!=INFF);
+        std::vector<std::tuple<int,double,int>> decide(3);
+        for(int axis=0;axis<3;axis++){
+            decide[axis] = {std::abs(count[axis]-(V-count[axis])),sur[axis],axis};
         }
+        std::sort(decide.begin(),decide.end());
+        int axis = std::get<2>(decide[0]);
 
-        //Y軸
+        //選んだ軸で、元の順番を保ったまま左右に並べ替える
+        int* sorted = arena.make<int>(V);
+        int l = 0,r = count[axis];
         for(int i=0;i<V;i++){
-            coor[i] = (Vertex[polygon[i][0]].point.y+Vertex[polygon[i][1]].point.y+Vertex[polygon[i][2]].point.y)/3.0;
+            if(centroid(polygon[i],axis) < med[axis])sorted[l++] = polygon[i];
+            else sorted[r++] = polygon[i];
         }
-        std::sort(coor.begin(),coor.end());
-        med = coor[V/2];
-        if(V%2==0)med = (coor[V/2]+coor[(V-1)/2])/2.0;
+        std::copy(sorted,sorted+V,polygon);
+        arena.rewind(marker);
 
-        std::vector<std::array<int,3>> poly_y[2];
-        p1={INFF,INFF,INFF},q1 = {-INFF,-INFF,-INFF},p2={INFF,INFF,INFF},q2 = {-INFF,-INFF,-INFF};
-        for(int i=0;i<V;i++){
-            if((Vertex[polygon[i][0]].point.y+Vertex[polygon[i][1]].point.y+Vertex[polygon[i][2]].point.y)/3.0 < med){
-                poly_y[0].push_back(polygon[i]);
-                for(int j=0;j<3;j++){
-                    p1.x = std::min(p1.x,Vertex[polygon[i][j]].point.x);
-                    p1.y = std::min(p1.y,Vertex[polygon[i][j]].point.y);
-                    p1.z = std::min(p1.z,Vertex[polygon[i][j]].point.z);
-                    q1.x = std::max(q1.x,Vertex[polygon[i][j]].point.x);
-                    q1.y = std::max(q1.y,Vertex[polygon[i][j]].point.y);
-                    q1.z = std::max(q1.z,Vertex[polygon[i][j]].point.z);
-                }
-            }else{
-                poly_y[1].push_back(polygon[i]);
-                for(int j=0;j<3;j++){
-                    p2.x = std::min(p2.x,Vertex[polygon[i][j]].point.x);
-                    p2.y = std::min(p2.y,Vertex[polygon[i][j]].point.y);
-                    p2.z = std::min(p2.z,Vertex[polygon[i][j]].point.z);
-                    q2.x = std::max(q2.x,Vertex[polygon[i][j]].point.x);
-                    q2.y = std::max(q2.y,Vertex[polygon[i][j]].point.y);
-                    q2.z = std::max(q2.z,Vertex[polygon[i][j]].point.z);
-                }
-                
+        construct_BVH_internal(polygon,count[axis],n,arena);
+        construct_BVH_internal(polygon+count[axis],V-count[axis],n+1,arena);
+
+    }
+
+    static double& axisRef(point3& p,int k){
+        return k==0 ? p.x : (k==1 ? p.y : p.z);
+    }
+
+    //参照rを軸axisの平面posで切り、三角形の両側の部分を囲む箱をleft,rightに入れる
+    void splitReference(const Reference& r,int axis,double pos,Reference& left,Reference& right){
+        const std::array<int,3>& tri = Polygon[r.poly];
+        Bounds L,R;
+        for(int j=0;j<3;j++){
+            const point3& a = Vertex[tri[j]].point;
+            const point3& b = Vertex[tri[(j+1)%3]].point;
+            double av = axisOf(a,axis), bv = axisOf(b,axis);
+            if(av<=pos)L.grow(a);
+            if(av>=pos)R.grow(a);
+            //辺が平面をまたぐなら交点を両側に入れる
+            if((av<pos && bv>pos) || (av>pos && bv<pos)){
+                double t = (pos-av)/(bv-av);
+                point3 c = {a.x+(b.x-a.x)*t, a.y+(b.y-a.y)*t, a.z+(b.z-a.z)*t};
+                axisRef(c,axis) = pos;
+                L.grow(c);
+                R.grow(c);
             }
         }
+        axisRef(L.M,axis) = std::min(axisOf(L.M,axis),pos);
+        axisRef(R.m,axis) = std::max(axisOf(R.m,axis),pos);
+        left = {r.poly,L.clip(r.box)};
+        right = {r.poly,R.clip(r.box)};
+    }
 
-        double sury = 2.0*((q1.y-p1.y)*(q1.z-p1.z)+(q1.z-p1.z)*(q1.x-p1.x)+(q1.x-p1.x)*(q1.y-p1.y))
-                        + 2.0*((q2.y-p2.y)*(q2.z-p2.z)+(q2.z-p2.z)*(q2.x-p2.x)+(q2.x-p2.x)*(q2.y-p2.y));
-        if(poly_y[0].empty() || poly_y[1].empty()){
-            sury = INFF;
+    //SAHで分割を選ぶBVHの構築(Stich et al. 2009 のSBVH)
+    //物体分割に加えて、三角形を平面で切って両側の子から参照する空間分割も試す
+    //空間分割で増やせる参照の数はbudgetまで
+    void construct_SBVH_internal(std::vector<Reference> refs,int index,int& budget){
+
+        int V = refs.size();
+        if(V<=0){return;}
+
+        Bounds box,cbox;
+        for(const Reference& r : refs){
+            box.grow(r.box);
+            cbox.grow(point3{(r.box.m.x+r.box.M.x)/2,(r.box.m.y+r.box.M.y)/2,(r.box.m.z+r.box.M.z)/2});
         }
 
-        //Z軸
-        for(int i=0;i<V;i++){
-            coor[i] = (Vertex[polygon[i][0]].point.z+Vertex[polygon[i][1]].point.z+Vertex[polygon[i][2]].point.z)/3.0;
+        if(V==1){
+            BVH bvh;
+            bvh.Box_m = box.m;
+            bvh.Box_M = box.M;
+            bvh.isLeaf = true;
+            bvh.triangle = Polygon[refs[0].poly];
+            bvh.prim = refs[0].poly;
+            Node[index] = bvh;
+            return;
         }
-        std::sort(coor.begin(),coor.end());
-        med = coor[V/2];
-        if(V%2==0)med = (coor[V/2]+coor[(V-1)/2])/2.0;
 
-        std::vector<std::array<int,3>> poly_z[2];
-        p1={INFF,INFF,INFF},q1 = {-INFF,-INFF,-INFF},p2={INFF,INFF,INFF},q2 = {-INFF,-INFF,-INFF};
-        for(int i=0;i<V;i++){
-            if((Vertex[polygon[i][0]].point.z+Vertex[polygon[i][1]].point.z+Vertex[polygon[i][2]].point.z)/3.0 < med){
-                poly_z[0].push_back(polygon[i]);
-                for(int j=0;j<3;j++){
-                    p1.x = std::min(p1.x,Vertex[polygon[i][j]].point.x);
-                    p1.y = std::min(p1.y,Vertex[polygon[i][j]].point.y);
-                    p1.z = std::min(p1.z,Vertex[polygon[i][j]].point.z);
-                    q1.x = std::max(q1.x,Vertex[polygon[i][j]].point.x);
-                    q1.y = std::max(q1.y,Vertex[polygon[i][j]].point.y);
-                    q1.z = std::max(q1.z,Vertex[polygon[i][j]].point.z);
-                }
-            }else{
-                poly_z[1].push_back(polygon[i]);
-                for(int j=0;j<3;j++){
-                    p2.x = std::min(p2.x,Vertex[polygon[i][j]].point.x);
-                    p2.y = std::min(p2.y,Vertex[polygon[i][j]].point.y);
-                    p2.z = std::min(p2.z,Vertex[polygon[i][j]].point.z);
-                    q2.x = std::max(q2.x,Vertex[polygon[i][j]].point.x);
-                    q2.y = std::max(q2.y,Vertex[polygon[i][j]].point.y);
-                    q2.z = std::max(q2.z,Vertex[polygon[i][j]].point.z);
+        auto centroid = [](const Reference& r,int axis){
+            return (axisOf(r.box.m,axis)+axisOf(r.box.M,axis))/2;
+        };
+        auto binOf = [](double x,double m,double M){
+            if(!(M>m))return 0;
+            return std::max(0,std::min(SBVH_BINS-1,(int)((x-m)/(M-m)*SBVH_BINS)));
+        };
+
+        //物体分割: 重心をビンに分けて、ビンの境界ごとにSAHを評価する
+        double bestCost = INFF;
+        int bestAxis = -1,bestSplit = -1;
+        bool spatial = false;
+        Bounds bestLeft,bestRight;
+        for(int axis=0;axis<3;axis++){
+            double cm = axisOf(cbox.m,axis),cM = axisOf(cbox.M,axis);
+            if(!(cM>cm))continue;
+            Bounds bins[SBVH_BINS];
+            int count[SBVH_BINS] = {};
+            for(const Reference& r : refs){
+                int b = binOf(centroid(r,axis),cm,cM);
+                bins[b].grow(r.box);
+                count[b]++;
+            }
+            Bounds right[SBVH_BINS];
+            Bounds acc;
+            for(int i=SBVH_BINS-1;i>0;i--){
+                acc.grow(bins[i]);
+                right[i] = acc;
+            }
+            Bounds left;
+            int nL = 0;
+            for(int i=0;i<SBVH_BINS-1;i++){
+                left.grow(bins[i]);
+                nL += count[i];
+                int nR = V-nL;
+                if(nL==0 || nR==0)continue;
+                double cost = left.area()*nL + right[i+1].area()*nR;
+                if(cost<bestCost){
+                    bestCost = cost;
+                    bestAxis = axis;
+                    bestSplit = i+1;
+                    bestLeft = left;
+                    bestRight = right[i+1];
                 }
-                
             }
         }
 
-        double surz = 2.0*((q1.y-p1.y)*(q1.z-p1.z)+(q1.z-p1.z)*(q1.x-p1.x)+(q1.x-p1.x)*(q1.y-p1.y))
-                        + 2.0*((q2.y-p2.y)*(q2.z-p2.z)+(q2.z-p2.z)*(q2.x-p2.x)+(q2.x-p2.x)*(q2.y-p2.y));
-        if(poly_z[0].empty() || poly_z[1].empty()){
-            surz = INFF;
+        //空間分割: 物体分割の子が大きく重なるときだけ、三角形を切ってビンに入れて評価する
+        if(budget>0 && (bestAxis<0 || bestLeft.clip(bestRight).area() > SBVH_ALPHA*RootArea)){
+            for(int axis=0;axis<3;axis++){
+                double bm = axisOf(box.m,axis),bM = axisOf(box.M,axis);
+                if(!(bM>bm))continue;
+                auto plane = [&](int i){ return bm + (bM-bm)*i/SBVH_BINS; };
+                Bounds bins[SBVH_BINS];
+                int entry[SBVH_BINS] = {},exit[SBVH_BINS] = {};
+                for(const Reference& r : refs){
+                    int first = binOf(axisOf(r.box.m,axis),bm,bM);
+                    int last = binOf(axisOf(r.box.M,axis),bm,bM);
+                    Reference cur = r;
+                    for(int b=first;b<last;b++){
+                        Reference L,R;
+                        splitReference(cur,axis,plane(b+1),L,R);
+                        bins[b].grow(L.box);
+                        cur = R;
+                    }
+                    bins[last].grow(cur.box);
+                    entry[first]++;
+                    exit[last]++;
+                }
+                Bounds right[SBVH_BINS];
+                int nRight[SBVH_BINS];
+                Bounds acc;
+                int n = 0;
+                for(int i=SBVH_BINS-1;i>0;i--){
+                    acc.grow(bins[i]);
+                    n += exit[i];
+                    right[i] = acc;
+                    nRight[i] = n;
+                }
+                Bounds left;
+                int nL = 0;
+                for(int i=0;i<SBVH_BINS-1;i++){
+                    left.grow(bins[i]);
+                    nL += entry[i];
+                    int nR = nRight[i+1];
+                    if(nL==0 || nR==0 || nL+nR-V>budget)continue;
+                    double cost = left.area()*nL + right[i+1].area()*nR;
+                    if(cost<bestCost){
+                        bestCost = cost;
+                        bestAxis = axis;
+                        bestSplit = i+1;
+                        spatial = true;
+                    }
+                }
+            }
         }
 
-        //３つの軸で、その軸を基準に分解したときの分解の仕方とその表面積が計算できた
-        //分解の均等さ<表面積の小ささで採用する軸を決定する
-        //２つに分けたものをそれぞれ次のBVH計算に与える
-        point3 P={INFF,INFF,INFF},Q = {-INFF,-INFF,-INFF};
-        for(int i=0;i<V;i++){
-            for(int j=0;j<3;j++){
-                P.x = std::min(P.x,Vertex[polygon[i][j]].point.x);
-                P.y = std::min(P.y,Vertex[polygon[i][j]].point.y);
-                P.z = std::min(P.z,Vertex[polygon[i][j]].point.z);
-                Q.x = std::max(Q.x,Vertex[polygon[i][j]].point.x);
-                Q.y = std::max(Q.y,Vertex[polygon[i][j]].point.y);
-                Q.z = std::max(Q.z,Vertex[polygon[i][j]].point.z);
+        std::vector<Reference> child[2];
+        if(bestAxis>=0 && spatial){
+            double pos = axisOf(box.m,bestAxis) + (axisOf(box.M,bestAxis)-axisOf(box.m,bestAxis))*bestSplit/SBVH_BINS;
+            for(const Reference& r : refs){
+                if(axisOf(r.box.M,bestAxis)<=pos){
+                    child[0].push_back(r);
+                }else if(axisOf(r.box.m,bestAxis)>=pos){
+                    child[1].push_back(r);
+                }else{
+                    Reference L,R;
+                    splitReference(r,bestAxis,pos,L,R);
+                    if(L.box.valid())child[0].push_back(L);
+                    if(R.box.valid())child[1].push_back(R);
+                    if(!L.box.valid() && !R.box.valid())child[0].push_back(r);
+                }
+            }
+            budget = std::max(0,budget-((int)child[0].size()+(int)child[1].size()-V));
+        }else if(bestAxis>=0){
+            double cm = axisOf(cbox.m,bestAxis),cM = axisOf(cbox.M,bestAxis);
+            for(const Reference& r : refs){
+                child[binOf(centroid(r,bestAxis),cm,cM)<bestSplit ? 0 : 1].push_back(r);
             }
         }
 
+        //重心が全て同じなどで分けられないときは、数で半分に分ける
+        if(child[0].empty() || child[1].empty()){
+            child[0].clear();
+            child[1].clear();
+            int axis = 0;
+            if(axisOf(box.M,1)-axisOf(box.m,1) > axisOf(box.M,axis)-axisOf(box.m,axis))axis = 1;
+            if(axisOf(box.M,2)-axisOf(box.m,2) > axisOf(box.M,axis)-axisOf(box.m,axis))axis = 2;
+            std::nth_element(refs.begin(),refs.begin()+V/2,refs.end(),[&](const Reference& a,const Reference& b){
+                return centroid(a,axis) < centroid(b,axis);
+            });
+            child[0].assign(refs.begin(),refs.begin()+V/2);
+            child[1].assign(refs.begin()+V/2,refs.end());
+        }
+
         BVH bvh;
-        bvh.Box_m = P;
-        bvh.Box_M = Q;
+        bvh.Box_m = box.m;
+        bvh.Box_M = box.M;
         bvh.isLeaf = false;
 
         int n = Node.size();
         Node.resize(n+2);
         bvh.children[0] = n;
         bvh.children[1] = n+1;
-
         Node[index] = bvh;
 
-        assert(std::min({surx,sury,surz})!=INFF);
-        std::vector<std::tuple<int,double,int>> decide(3);
-        decide[0] = {std::abs((int)poly_x[0].size()-(int)poly_x[1].size()),surx,0};
-        decide[1] = {std::abs((int)poly_y[0].size()-(int)poly_y[1].size()),sury,1};
-        decide[2] = {std::abs((int)poly_z[0].size()-(int)poly_z[1].size()),surz,2};
-        std::sort(decide.begin(),decide.end());
-
-        if(std::get<2>(decide[0])==0){
-            construct_BVH_internal(poly_x[0],n);
-            construct_BVH_internal(poly_x[1],n+1);
-        }else if(std::get<2>(decide[0])==1){
-            construct_BVH_internal(poly_y[0],n);
-            construct_BVH_internal(poly_y[1],n+1);
-        }else{
-            construct_BVH_internal(poly_z[0],n);
-            construct_BVH_internal(poly_z[1],n+1);
-        }
-
+        std::vector<Reference>().swap(refs);
+        construct_SBVH_internal(std::move(child[0]),n,budget);
+        construct_SBVH_internal(std::move(child[1]),n+1,budget);
     }
 
     public:
     
-    void construct(std::vector<vert> vertex,std::vector<std::array<int,3>> polygon){
-        Vertex = vertex;
+    //vertex,polygonはムーブで渡せばコピーされない
+    //splitBudgetが正なら空間分割ありのSBVHで構築し、三角形の参照をポリゴン数のsplitBudget倍まで増やしてよい
+    //0なら重心の中央値で分ける従来の構築
+    void construct(std::vector<vert> vertex,std::vector<std::array<int,3>> polygon,double splitBudget = 0){
+        Vertex = std::move(vertex);
+        Polygon = std::move(polygon);
+        weldVertices(Vertex,Polygon);
+        PolygonCount = Polygon.size();
+
+        int budget = splitBudget>0 ? (int)(splitBudget*Polygon.size()) : 0;
         Node.clear();
+        Node.reserve(2*(Polygon.size()+budget));
         Node.resize(1);
-        construct_BVH_internal(polygon,0);
+        if(splitBudget>0){
+            std::vector<Reference> refs(Polygon.size());
+            Bounds root;
+            for(int i=0;i<(int)refs.size();i++){
+                refs[i].poly = i;
+                for(int j=0;j<3;j++)refs[i].box.grow(Vertex[Polygon[i][j]].point);
+                root.grow(refs[i].box);
+            }
+            RootArea = root.area();
+            construct_SBVH_internal(std::move(refs),0,budget);
+        }else{
+            //作業用の配列はまとめて確保し、構築が終わったらまとめて捨てる
+            Arena arena(Polygon.size()*(sizeof(int)*2+sizeof(double))+256);
+            int* ids = arena.make<int>(Polygon.size());
+            for(int i=0;i<(int)Polygon.size();i++)ids[i] = i;
+            construct_BVH_internal(ids,Polygon.size(),0,arena);
+        }
+
+        //葉は1つの三角形を参照するので、参照の数は葉の数((ノード数+1)/2)。空間分割で複製された分も含めてちょうど確保する
+        const size_t refs = Polygon.empty() ? 0 : (Node.size()+1)/2;
+        Triangles.clear();
+        LeafTriangle.clear();
+        LeafPrim.clear();
+        Triangles.reserve(refs);
+        LeafTriangle.reserve(refs);
+        LeafPrim.reserve(refs);
+        if(!Polygon.empty())construct_triangles_internal(0);
+
+        //頂点を葉の順に並べ替える
+        reorderVertices(Vertex,LeafTriangle);
+
+        //構築が終われば元のポリゴンのリストは要らない
+        std::vector<std::array<int,3>>().swap(Polygon);
+        Node.shrink_to_fit();
+        Node8.clear();
+        Node16.clear();
+        nodeBits = 0;
+    }
+
+    //ノードを親の箱からの相対座標でbits(8か16)ビットに量子化した形式に変換し、元のノードを解放する
+    //箱は外側に丸めるので交差の結果は変わらない(余分に調べる箱が少し増えるだけ)
+    //元のノードがもう無い(別の形式に圧縮済み)ならfalseを返す
+    bool compress(int bits){
+        if(bits==nodeBits)return true;
+        if(nodeBits!=0 || (bits!=8 && bits!=16))return false;
+        if(Node.empty())return true;
+
+        RootBox_m = Node[0].Box_m;
+        RootBox_M = Node[0].Box_M;
+        if(bits==8){
+            Node8.reserve(Node.size()/2);
+            Root = compress_internal(Node8,0,RootBox_m,RootBox_M);
+        }else{
+            Node16.reserve(Node.size()/2);
+            Root = compress_internal(Node16,0,RootBox_m,RootBox_M);
+        }
+        nodeBits = bits;
+        std::vector<BVH>().swap(Node);
+        return true;
+    }
+
+    int compressionBits() const {
+        return nodeBits;
+    }
+
+    //BVHのノードが使っているバイト数
+    size_t nodeBytes() const {
+        return Node.capacity()*sizeof(BVH)
+            + Node8.capacity()*sizeof(QuantizedBVH<uint8_t>)
+            + Node16.capacity()*sizeof(QuantizedBVH<uint16_t>);
+    }
+
+    //頂点と三角形が使っているバイト数
+    size_t geometryBytes() const {
+        return Vertex.capacity()*sizeof(vert)
+            + Triangles.capacity()*sizeof(TriangleRecord)
+            + LeafTriangle.capacity()*sizeof(std::array<int,3>)
+            + LeafPrim.capacity()*sizeof(int);
+    }
+
+    //頂点数vertexCount、ポリゴン数triangleCountのモデルを構築するときに必要になるバイト数の見積もり
+    //構築中は量子化する前のノードがあるので、圧縮するかどうかに関係なくそのノードで数える
+    //参照の数はconstructと同じ式で上限を求めるので、構築後に使うバイト数はこれを超えない
+    static size_t estimateBytes(int vertexCount,int triangleCount,double splitBudget){
+        size_t refs = (size_t)triangleCount + (splitBudget>0 ? (size_t)(int)(splitBudget*triangleCount) : 0);
+        return (size_t)vertexCount*sizeof(vert)
+            + refs*(sizeof(TriangleRecord)+sizeof(std::array<int,3>)+sizeof(int))
+            + 2*refs*sizeof(BVH);
     }
 
-    private:    
-    rayHit intersectModel_internal(point3 o,vec3 d,int index){
+    int triangleCount() const {
+        return PolygonCount;
+    }
+
+    //葉から参照している三角形の数(空間分割で複製された分を含む)
+    int referenceCount() const {
+        return Triangles.size();
+    }
 
+    private:
+    //BVHを深さ優先でたどり、葉の順に三角形を並べる
+    void construct_triangles_internal(int index){
         if(Node[index].isLeaf){
-            tri3 tri;
-            tri.vertex[0] = Vertex[Node[index].triangle[0]].point,tri.vertex[1] = Vertex[Node[index].triangle[1]].point,tri.vertex[2] = Vertex[Node[index].triangle[2]].point;
-            rayHit P = intersectTriangle(o,d,tri);
-            // 最小衝突距離
-            point3 diff = point3{P.point.x - o.x, P.point.y - o.y, P.point.z - o.z};
-            double dist = diff.x * diff.x + diff.y * diff.y + diff.z * diff.z;
-
-            if(!P.isHit || dist < MINIMUM_INTERSECT_DISTANCE_2){
-                return {false,{INFF,INFF,INFF},-1,{0,0,0},-1,-1,{INFF,INFF}};
+            Node[index].first = Triangles.size();
+            Triangles.push_back({
+                Vertex[Node[index].triangle[0]].point,
+                Vertex[Node[index].triangle[1]].point,
+                Vertex[Node[index].triangle[2]].point
+            });
+            LeafTriangle.push_back(Node[index].triangle);
+            LeafPrim.push_back(Node[index].prim);
+            return;
+        }
+        construct_triangles_internal(Node[index].children[0]);
+        construct_triangles_internal(Node[index].children[1]);
+    }
+
+    //Node[index](復元後の箱は[m,M])を量子化してoutに加え、その番号を返す(葉なら~Triangles上の位置)
+    template<typename T>
+    int compress_internal(std::vector<QuantizedBVH<T>>& out,int index,point3 m,point3 M){
+        if(Node[index].isLeaf)return ~Node[index].first;
+
+        const int Q = std::numeric_limits<T>::max();
+        int q = out.size();
+        out.push_back({});
+        for(int c=0;c<2;c++){
+            const BVH& child = Node[Node[index].children[c]];
+            std::array<T,3> lo,hi;
+            point3 cm,cM;
+            for(int k=0;k<3;k++){
+                double pm = axisOf(m,k),pM = axisOf(M,k);
+                lo[k] = quantize(pm,pM,axisOf(child.Box_m,k),Q,false);
+                hi[k] = quantize(pm,pM,axisOf(child.Box_M,k),Q,true);
             }
-            
-            vec3 n0 = Vertex[Node[index].triangle[0]].norm, n1 = Vertex[Node[index].triangle[1]].norm, n2 = Vertex[Node[index].triangle[2]].norm;
-            texpoint tex0 = Vertex[Node[index].triangle[0]].texcoord, tex1 = Vertex[Node[index].triangle[1]].texcoord, tex2 = Vertex[Node[index].triangle[2]].texcoord;
-
-            double zu = P.u,zv = P.v,zw = 1.0-P.u-P.v;
-            vec3 Z = {zw*zw,zu*zu,zv*zv};
-            double Zl = Z.x+Z.y+Z.z;
-            double w = Z.x/Zl,u = Z.y/Zl,v = Z.z/Zl;
-            return {
-                P.isHit,
-                P.point,
-                index,
-                normalize({
-                    w*n0.x + u*n1.x + v*n2.x,
-                    w*n0.y + u*n1.y + v*n2.y,
-                    w*n0.z + u*n1.z + v*n2.z,
-                }),
-                P.u,
-                P.v,
-                {
-                    (1-P.u-P.v)*tex0.x+P.u*tex1.x+P.v*tex2.x,
-                    (1-P.u-P.v)*tex0.y+P.u*tex1.y+P.v*tex2.y
-                }
-                //normalVector({Vertex[Node[index].triangle[0]].point,Vertex[Node[index].triangle[1]].point,Vertex[Node[index].triangle[2]].point})
-            };
+            cm = {dequantize(m.x,M.x,lo[0],Q),dequantize(m.y,M.y,lo[1],Q),dequantize(m.z,M.z,lo[2],Q)};
+            cM = {dequantize(m.x,M.x,hi[0],Q),dequantize(m.y,M.y,hi[1],Q),dequantize(m.z,M.z,hi[2],Q)};
+            int ci = compress_internal(out,Node[index].children[c],cm,cM);
+            out[q].lo[c] = lo;
+            out[q].hi[c] = hi;
+            out[q].children[c] = ci;
         }
+        return q;
+    }
 
-        int child1 = Node[index].children[0], child2 = Node[index].children[1];
-        std::pair<bool,point3> inter1 = intersectBox(o,d,Node[child1].Box_m,Node[child1].Box_M);
-        std::pair<bool,point3> inter2 = intersectBox(o,d,Node[child2].Box_m,Node[child2].Box_M);
+    //葉の三角形Triangles[first]とrayの交差を調べ、hitより近ければ更新する
+    void intersectLeaf(const rayQuery& r,int first,double tMin,triHit& hit){
+        STATS_ADD(nodeVisits,1);
+        STATS_ADD(triangleTests,1);
+        const TriangleRecord& T = Triangles[first];
+        triHit h = intersectTriangleWatertight(r,T.v0,T.v1,T.v2,tMin,hit.t);
+        if(h.isHit){
+            h.prim = first;
+            hit = h;
+        }
+    }
 
-        if(!inter1.first && !inter2.first){
-            return {false,{INFF,INFF,INFF},-1,{0,0,0},-1,-1,{INFF,INFF}};
+    //圧縮したBVHをたどる。子の箱はその場で親の箱[m,M]から復元する
+    //anyHitなら何か1つ当たった時点でやめる
+    template<typename T>
+    void intersectQuantized_internal(const std::vector<QuantizedBVH<T>>& nodes,const rayQuery& r,int index,const point3& m,const point3& M,double tMin,triHit& hit,bool anyHit){
+        if(index<0){
+            intersectLeaf(r,~index,tMin,hit);
+            return;
         }
-        if(!inter1.first){
-            return intersectModel_internal(o,d,child2);
+
+        STATS_ADD(nodeVisits,1);
+        const int Q = std::numeric_limits<T>::max();
+        const QuantizedBVH<T>& node = nodes[index];
+        point3 cm[2],cM[2];
+        double t[2];
+        bool inter[2];
+        for(int c=0;c<2;c++){
+            cm[c] = {dequantize(m.x,M.x,node.lo[c][0],Q),dequantize(m.y,M.y,node.lo[c][1],Q),dequantize(m.z,M.z,node.lo[c][2],Q)};
+            cM[c] = {dequantize(m.x,M.x,node.hi[c][0],Q),dequantize(m.y,M.y,node.hi[c][1],Q),dequantize(m.z,M.z,node.hi[c][2],Q)};
+            inter[c] = intersectBoxInterval(r,cm[c],cM[c],tMin,hit.t,t[c]);
         }
-        if(!inter2.first){
-            return intersectModel_internal(o,d,child1);
+
+        //近い方から調べる
+        int first = 0;
+        if(!inter[0] || (inter[1] && t[1] < t[0]))first = 1;
+        int second = 1-first;
+
+        if(inter[first]){
+            intersectQuantized_internal(nodes,r,node.children[first],cm[first],cM[first],tMin,hit,anyHit);
+            if(anyHit && hit.isHit)return;
+        }
+        if(inter[second] && t[second] < hit.t){
+            intersectQuantized_internal(nodes,r,node.children[second],cm[second],cM[second],tMin,hit,anyHit);
         }
-        rayHit col1 = intersectModel_internal(o,d,child1);
-        rayHit col2 = intersectModel_internal(o,d,child2);
+    }
 
-        double dx1 = col1.point.x-o.x,dy1 = col1.point.y-o.y,dz1 = col1.point.z-o.z;
-        double dist21 = dx1*dx1+dy1*dy1+dz1*dz1;
-        double dx2 = col2.point.x-o.x,dy2 = col2.point.y-o.y,dz2 = col2.point.z-o.z;
-        double dist22 = dx2*dx2+dy2*dy2+dz2*dz2;
+    //rayと[tMin,hit.t]の範囲で交差する最も近い三角形を探す
+    //hit.tは見つかるたびに縮むので、それより遠い箱は調べない
+    //anyHitなら何か1つ当たった時点でやめる
+    void intersectModel_internal(const rayQuery& r,int index,double tMin,triHit& hit,bool anyHit){
 
-        if(!col1.isHit && !col2.isHit){
-            return {false,{INFF,INFF,INFF},-1,{0,0,0},-1,-1,{INFF,INFF}};
+        if(Node[index].isLeaf){
+            intersectLeaf(r,Node[index].first,tMin,hit);
+            return;
         }
-        if(!col1.isHit){
-            return col2;
+        STATS_ADD(nodeVisits,1);
+
+        int child1 = Node[index].children[0], child2 = Node[index].children[1];
+        double t1,t2;
+        bool inter1 = intersectBoxInterval(r,Node[child1].Box_m,Node[child1].Box_M,tMin,hit.t,t1);
+        bool inter2 = intersectBoxInterval(r,Node[child2].Box_m,Node[child2].Box_M,tMin,hit.t,t2);
+
+        //近い方から調べる
+        if(inter1 && inter2 && t2 < t1){
+            std::swap(child1,child2);
+            std::swap(t1,t2);
+        }else if(!inter1){
+            std::swap(child1,child2);
+            std::swap(t1,t2);
+            std::swap(inter1,inter2);
         }
-        if(!col2.isHit){
-            return col1;
+
+        if(inter1){
+            intersectModel_internal(r,child1,tMin,hit,anyHit);
+            if(anyHit && hit.isHit)return;
         }
-        if(dist21 <= dist22){
-            return col1;
-        }else{
-            return col2;
+        if(inter2 && t2 < hit.t){
+            intersectModel_internal(r,child2,tMin,hit,anyHit);
         }
-        return {false,{INFF,INFF,INFF},-1,{0,0,0},-1,-1,{INFF,INFF}};
     }
-    
+
     public:
-    //rayの始点oと向きdを与えると、予め与えたモデルの表面にrayが当たるかを判定し、当たらないならfalseを、当たるならtrueとそのポイントを返す
-    rayHit intersectModel(point3 o,vec3 d){
-        if(!intersectBox(o,d,Node[0].Box_m,Node[0].Box_M).first){
+    //rayの始点oと向きdを与えると、[tMin,tMax]の範囲で最も近い三角形との交差を返す
+    //返すのはt,u,vと三角形番号(葉の順)のみで、法線などの補間はしない
+    //anyHitなら最も近いとは限らない交差が1つ見つかった時点で返す(遮蔽の判定用)
+    triHit intersectModelClosest(point3 o,vec3 d,double tMin,double tMax,bool anyHit = false){
+        triHit hit = {false,tMax,-1,-1,-1};
+        if(Triangles.empty())return hit;
+
+        rayQuery r = prepareRay(o,d);
+        double t;
+        if(nodeBits!=0){
+            if(!intersectBoxInterval(r,RootBox_m,RootBox_M,tMin,tMax,t)){
+                return hit;
+            }
+            if(nodeBits==8)intersectQuantized_internal(Node8,r,Root,RootBox_m,RootBox_M,tMin,hit,anyHit);
+            else intersectQuantized_internal(Node16,r,Root,RootBox_m,RootBox_M,tMin,hit,anyHit);
+            return hit;
+        }
+
+        if(!intersectBoxInterval(r,Node[0].Box_m,Node[0].Box_M,tMin,tMax,t)){
+            return hit;
+        }
+        intersectModel_internal(r,0,tMin,hit,anyHit);
+        return hit;
+    }
+
+    //三角形番号primの重心座標(u,v)での法線とテクスチャ座標を補間する
+    void attributes(int prim,double hu,double hv,vec3& normal,texpoint& texcoord) const {
+        const std::array<int,3>& tri = LeafTriangle[prim];
+        vec3 n0 = Vertex[tri[0]].norm, n1 = Vertex[tri[1]].norm, n2 = Vertex[tri[2]].norm;
+        texpoint tex0 = Vertex[tri[0]].texcoord, tex1 = Vertex[tri[1]].texcoord, tex2 = Vertex[tri[2]].texcoord;
+
+        double zu = hu,zv = hv,zw = 1.0-hu-hv;
+        vec3 Z = {zw*zw,zu*zu,zv*zv};
+        double Zl = Z.x+Z.y+Z.z;
+        double w = Z.x/Zl,u = Z.y/Zl,v = Z.z/Zl;
+        normal = normalize({
+            w*n0.x + u*n1.x + v*n2.x,
+            w*n0.y + u*n1.y + v*n2.y,
+            w*n0.z + u*n1.z + v*n2.z,
+        });
+        texcoord = {
+            (1-hu-hv)*tex0.x+hu*tex1.x+hv*tex2.x,
+            (1-hu-hv)*tex0.y+hu*tex1.y+hv*tex2.y
+        };
+    }
+
+    //葉の順に三角形ごとにf(三角形番号,頂点0,頂点1,頂点2)を呼ぶ(モデル座標)
+    //SBVHで複数の葉に入った三角形は最初の1回だけ
+    template<typename F>
+    void forEachTriangle(F f) const {
+        std::vector<bool> seen(PolygonCount,false);
+        for(int prim=0;prim<(int)LeafTriangle.size();prim++){
+            if(seen[LeafPrim[prim]])continue;
+            seen[LeafPrim[prim]] = true;
+            const std::array<int,3>& tri = LeafTriangle[prim];
+            f(prim,Vertex[tri[0]].point,Vertex[tri[1]].point,Vertex[tri[2]].point);
+        }
+    }
+
+    //三角形番号(葉の順)から元のポリゴン番号を返す
+    int polygonOf(int prim) const {
+        return LeafPrim[prim];
+    }
+
+    //intersectModelClosestの結果から、交差点の座標・法線・テクスチャ座標を補間する
+    rayHit interpolate(point3 o,vec3 d,const triHit& h){
+        if(!h.isHit){
             return {false,{INFF,INFF,INFF},-1,{0,0,0},-1,-1,{INFF,INFF}};
         }
-        return intersectModel_internal(o,d,0);
+        rayHit ret = {true,{o.x+h.t*d.x, o.y+h.t*d.y, o.z+h.t*d.z},polygonOf(h.prim),{0,0,0},h.u,h.v,{INFF,INFF}};
+        attributes(h.prim,h.u,h.v,ret.normal,ret.texcoord);
+        return ret;
+    }
+
+    //rayの始点oと向きdを与えると、予め与えたモデルの表面にrayが当たるかを判定し、当たらないならfalseを、当たるならtrueとそのポイントを返す
+    rayHit intersectModel(point3 o,vec3 d){
+        return interpolate(o,d,intersectModelClosest(o,d,MINIMUM_INTERSECT_DISTANCE,INFF));
     }
 
 };
@@ -0,0 +1,166 @@
+// ネイティブで小さなシーンを描き、BVH のノード形式やレイのまとめ方ごとのメモリとレンダリング統計を表示する
+// make bench で RAYTRACER_STATS を有効にしてビルドし、実行する
+// 使い方: bench [幅] [高さ] [球の分割数]
+#define RAYTRACER_NO_MAIN
+#include "main.cpp"
+
+// 単位行列とその逆行列
+static float identity[32] = {
+  1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1,
+  1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1, 0, 0, 0, 0, 1,
+};
+
+// 内側を向いた箱 (部屋)
+static void addRoom(float x0, float y0, float z0, float x1, float y1, float z1, float* material) {
+  std::vector<float> position, normal, texCoord;
+  std::vector<int> index;
+  const float corner[2][3] = {{x0, y0, z0}, {x1, y1, z1}};
+  for (int axis = 0; axis < 3; axis += 1) {
+    for (int side = 0; side < 2; side += 1) {
+      const int a1 = (axis + 1) % 3, a2 = (axis + 2) % 3;
+      const int base = position.size() / 3;
+      for (int k = 0; k < 4; k += 1) {
+        float p[3], n[3] = {0, 0, 0};
+        p[axis] = corner[side][axis];
+        p[a1] = corner[k & 1][a1];
+        p[a2] = corner[(k >> 1) & 1][a2];
+        n[axis] = side ? -1 : 1;
+        position.insert(position.end(), p, p + 3);
+        normal.insert(normal.end(), n, n + 3);
+        texCoord.push_back(k & 1);
+        texCoord.push_back((k >> 1) & 1);
+      }
+      index.insert(index.end(), {base, base + 1, base + 3, base, base + 3, base + 2});
+    }
+  }
+  createBounding(position.data(), position.size() / 3, index.data(), index.size() / 3,
+    normal.data(), normal.size() / 3, texCoord.data(), texCoord.size() / 2, identity, material);
+}
+
+// 中心 (cx, cy, cz)、半径 r の UV 球。緯度方向を seg、経度方向を 2*seg に分ける
+static void addSphere(float cx, float cy, float cz, float r, int seg, float* material) {
+  std::vector<float> position, normal, texCoord;
+  std::vector<int> index;
+  for (int i = 0; i <= seg; i += 1) {
+    for (int j = 0; j <= 2 * seg; j += 1) {
+      const double theta = M_PI * i / seg, phi = M_PI * j / seg;
+      const double n[3] = {sin(theta) * cos(phi), cos(theta), sin(theta) * sin(phi)};
+      for (int c = 0; c < 3; c += 1) {
+        position.push_back((c == 0 ? cx : c == 1 ? cy : cz) + r * n[c]);
+        normal.push_back(n[c]);
+      }
+      texCoord.push_back(j / (2.0 * seg));
+      texCoord.push_back(i / (double)seg);
+    }
+  }
+  const int w = 2 * seg + 1;
+  for (int i = 0; i < seg; i += 1) {
+    for (int j = 0; j < 2 * seg; j += 1) {
+      const int a = i * w + j, b = a + 1, c = a + w, d = c + 1;
+      index.insert(index.end(), {a, c, b, b, c, d});
+    }
+  }
+  createBounding(position.data(), position.size() / 3, index.data(), index.size() / 3,
+    normal.data(), normal.size() / 3, texCoord.data(), texCoord.size() / 2, identity, material);
+}
+
+// 原点を (2.5, 1, 2.5) から見るカメラ
+static void lookAtOrigin() {
+  const double eye[3] = {2.5, 1, 2.5};
+  double f[3] = {-eye[0], -eye[1], -eye[2]};
+  double l = sqrt(f[0] * f[0] + f[1] * f[1] + f[2] * f[2]);
+  for (int i = 0; i < 3; i += 1) f[i] /= l;
+  double r[3] = {-f[2], 0, f[0]};
+  l = sqrt(r[0] * r[0] + r[2] * r[2]);
+  r[0] /= l;
+  r[2] /= l;
+  const double u[3] = {r[1] * f[2] - r[2] * f[1], r[2] * f[0] - r[0] * f[2], r[0] * f[1] - r[1] * f[0]};
+  float cam[13] = {
+    (float)eye[0], (float)eye[1], (float)eye[2],
+    (float)f[0], (float)f[1], (float)f[2],
+    (float)u[0], (float)u[1], (float)u[2],
+    (float)r[0], (float)r[1], (float)r[2],
+    1,
+  };
+  setCamera(cam);
+}
+
+static double msSince(std::chrono::steady_clock::time_point t) {
+  return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - t).count();
+}
+
+struct BenchResult {
+  double buildMs;
+  double renderMs;
+  RenderStats stats;
+};
+
+// シーンを作り直し、乱数を同じ状態に戻して1フレーム描く
+static BenchResult run(int bits, int batching, int width, int height, int seg) {
+  static float diffuse[5] = {0, -1, 0.25, 0.25, 0.25};
+  static float red[5] = {0, -1, 0.9, 0.3, 0.3};
+  static float glass[2] = {1, 1.5};
+
+  BenchResult result;
+  stream.settings.stage = Stage();
+  setBVHCompression(bits);
+  setRayBatching(batching);
+  auto t0 = std::chrono::steady_clock::now();
+  addRoom(-3, -1, -3, 3, 4, 3, diffuse);
+  addSphere(0.5, 0, 0, 0.6, seg, red);
+  addSphere(-0.8, 0, 0.3, 0.5, seg, glass);
+  result.buildMs = msSince(t0);
+
+  Raytracer::mt.seed(1183276428);
+  std::vector<int> pixels(width * height * 4);
+  t0 = std::chrono::steady_clock::now();
+  pathTracer(pixels.data(), width, height);
+  while (readStream(pixels.data()) != 0) {
+  }
+  result.renderMs = msSince(t0);
+  result.stats = renderStats;
+  return result;
+}
+
+static void printHeader() {
+  printf("%-10s %9s %9s %10s %9s %9s %10s %9s %9s %9s %11s %11s %9s\n",
+    "mode", "triangles", "refs", "nodeBytes", "bytes/tri", "build ms", "render ms",
+    "camera", "bounce", "shadow", "nodeVisits", "triTests", "cost/ray");
+}
+
+static void printRow(const char* mode, const BenchResult& r) {
+  const RenderStats& s = r.stats;
+  const long long rays = s.cameraRays + s.bounceRays + s.shadowRays;
+  printf("%-10s %9lld %9lld %10lld %9.1f %9.1f %10.1f %9lld %9lld %9lld %11lld %11lld %9.1f\n",
+    mode, s.triangles, s.references, s.bvhNodeBytes, (double)s.bvhNodeBytes / std::max(1LL, s.triangles),
+    r.buildMs, r.renderMs, s.cameraRays, s.bounceRays, s.shadowRays, s.nodeVisits, s.triangleTests,
+    rays > 0 ? (double)s.traversalCost() / rays : 0.0);
+}
+
+int main(int argc, char** argv) {
+  const int width = argc > 1 ? atoi(argv[1]) : 160;
+  const int height = argc > 2 ? atoi(argv[2]) : 120;
+  const int seg = argc > 3 ? atoi(argv[3]) : 64;
+#ifndef RAYTRACER_STATS
+  printf("RAYTRACER_STATS is off: ray and traversal counters stay 0\n");
+#endif
+  lookAtOrigin();
+  printf("%dx%d, %d spp\n", width, height, stream.settings.spp);
+
+  printf("\nBVH node format (setBVHCompression)\n");
+  printHeader();
+  const int formats[3] = {0, 16, 8};
+  for (int bits : formats) {
+    char mode[16];
+    snprintf(mode, sizeof(mode), bits ? "%d bit" : "float", bits);
+    printRow(mode, run(bits, 0, width, height, seg));
+  }
+
+  printf("\nRay batching (setRayBatching)\n");
+  printHeader();
+  const char* batchings[3] = {"pixel", "tile", "tile+sort"};
+  for (int batching = 0; batching < 3; batching += 1) {
+    printRow(batchings[batching], run(0, batching, width, height, seg));
+  }
+  return 0;
+}
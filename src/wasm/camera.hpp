@@ -11,6 +11,14 @@ struct camera {
     camRight(0.0, 0.0, 1.0)
     {}
   
+  bool equals(const camera& c) const {
+    return dist == c.dist &&
+      pos.x == c.pos.x && pos.y == c.pos.y && pos.z == c.pos.z &&
+      forward.x == c.forward.x && forward.y == c.forward.y && forward.z == c.forward.z &&
+      camUp.x == c.camUp.x && camUp.y == c.camUp.y && camUp.z == c.camUp.z &&
+      camRight.x == c.camRight.x && camRight.y == c.camRight.y && camRight.z == c.camRight.z;
+  }
+
   Raytracer::Ray getRay(double u, double v) {
     Raytracer::Vec3 sensPos = pos - forward * dist - camUp * v - camRight * u;
     return Raytracer::Ray(pos, normalize(pos - sensPos));
@@ -0,0 +1,85 @@
+#ifndef CHECKPOINT_HPP
+#define CHECKPOINT_HPP
+
+#include <vector>
+#include <string>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+
+//チェックポイントのバイト列を組み立てる
+//値はメモリ上の表現のまま並べるので、同じビルドの wasm で読み戻せば1ビットも変わらない
+struct CheckpointWriter{
+    std::vector<uint8_t> bytes;
+
+    template<typename T>
+    void put(const T& v){
+        static_assert(std::is_trivially_copyable<T>::value, "checkpoint values must be trivially copyable");
+        const uint8_t* p = reinterpret_cast<const uint8_t*>(&v);
+        bytes.insert(bytes.end(),p,p + sizeof(T));
+    }
+
+    //要素数を前に付けて配列を並べる
+    template<typename T>
+    void putArray(const std::vector<T>& v){
+        static_assert(std::is_trivially_copyable<T>::value, "checkpoint values must be trivially copyable");
+        put((uint64_t)v.size());
+        const uint8_t* p = reinterpret_cast<const uint8_t*>(v.data());
+        bytes.insert(bytes.end(),p,p + v.size() * sizeof(T));
+    }
+
+    void putString(const std::string& s){
+        put((uint64_t)s.size());
+        bytes.insert(bytes.end(),s.begin(),s.end());
+    }
+};
+
+//CheckpointWriter で作ったバイト列を先頭から読む
+//途中で足りなくなったら ok を false にし、以降は何も読まない
+struct CheckpointReader{
+    const uint8_t* data;
+    size_t size;
+    size_t pos = 0;
+    bool ok = true;
+
+    CheckpointReader(const uint8_t* d,size_t s) : data(d),size(s) {}
+
+    template<typename T>
+    T get(){
+        T v{};
+        if(!ok || size - pos < sizeof(T)){
+            ok = false;
+            return v;
+        }
+        std::memcpy(&v,data + pos,sizeof(T));
+        pos += sizeof(T);
+        return v;
+    }
+
+    //要素数が count でなければ失敗にする(count < 0 なら問わない)
+    template<typename T>
+    bool getArray(std::vector<T>& v,long long count = -1){
+        uint64_t n = get<uint64_t>();
+        if(!ok || (count >= 0 && n != (uint64_t)count) || (size - pos) / sizeof(T) < n){
+            ok = false;
+            return false;
+        }
+        v.resize(n);
+        std::memcpy(v.data(),data + pos,n * sizeof(T));
+        pos += n * sizeof(T);
+        return true;
+    }
+
+    std::string getString(){
+        uint64_t n = get<uint64_t>();
+        if(!ok || size - pos < n){
+            ok = false;
+            return std::string();
+        }
+        std::string s(reinterpret_cast<const char*>(data + pos),n);
+        pos += n;
+        return s;
+    }
+};
+
+#endif
@@ -0,0 +1,65 @@
+#ifndef FRAMEBUFFER_HPP
+#define FRAMEBUFFER_HPP
+
+#include <vector>
+#include "raytracer/vec3.hpp"
+#include "raytracer/gbuffer.hpp"
+
+//レンダリング結果の累積バッファ
+//解像度が変わったときだけ確保し直し、カメラやシーンが変わらない限りサンプルを足し続ける
+struct Framebuffer{
+    int width = 0, height = 0;
+    std::vector<Raytracer::Vec3> color; //放射輝度の和
+    std::vector<Raytracer::GBufferSample> gbuffer; //G-bufferの和
+    std::vector<int> samples; //画素ごとのサンプル数
+
+    //解像度が変わったら確保し直してtrueを返す
+    bool resize(int w, int h){
+        if(w == width && h == height) return false;
+        width = w;
+        height = h;
+        color.assign(w * h, Raytracer::Vec3());
+        gbuffer.assign(w * h, Raytracer::GBufferSample());
+        samples.assign(w * h, 0);
+        return true;
+    }
+
+    void clear(){
+        std::fill(color.begin(), color.end(), Raytracer::Vec3());
+        std::fill(gbuffer.begin(), gbuffer.end(), Raytracer::GBufferSample());
+        std::fill(samples.begin(), samples.end(), 0);
+    }
+
+    //width*heightの累積バッファが使うバイト数
+    static size_t bytesOf(int w, int h){
+        return (size_t)w * h * (sizeof(Raytracer::Vec3) + sizeof(Raytracer::GBufferSample) + sizeof(int));
+    }
+
+    size_t bytes() const {
+        return color.capacity() * sizeof(Raytracer::Vec3)
+            + gbuffer.capacity() * sizeof(Raytracer::GBufferSample)
+            + samples.capacity() * sizeof(int);
+    }
+
+    bool empty() const {
+        return color.empty();
+    }
+
+    void add(int index, const Raytracer::Vec3& c, const Raytracer::GBufferSample& g, int n){
+        color[index] += c;
+        gbuffer[index] += g;
+        samples[index] += n;
+    }
+
+    Raytracer::Vec3 averageColor(int index) const {
+        return samples[index] > 0 ? color[index] / samples[index] : Raytracer::Vec3();
+    }
+
+    Raytracer::GBufferSample averageGBuffer(int index) const {
+        Raytracer::GBufferSample g = gbuffer[index];
+        if(samples[index] > 0) g *= 1.0 / samples[index];
+        return g;
+    }
+};
+
+#endif
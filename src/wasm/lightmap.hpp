@@ -0,0 +1,144 @@
+#ifndef LIGHTMAP_HPP
+#define LIGHTMAP_HPP
+
+#include <vector>
+#include <array>
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include "raytracer/vec3.hpp"
+
+//焼き込みに使う乱数の種(描画の乱数とは別の列にする)
+#define LIGHTMAP_SEED 2463534242u
+
+//ライトマップの1テクセルが覆う表面上の点
+struct LightmapTexel{
+    Raytracer::Vec3 point; //ワールド座標
+    Raytracer::Vec3 normal; //ワールド座標(正規化済み)
+    int index; //ライトマップ上の番号 (y * size + x)
+};
+
+//2つ目のUVでメッシュを展開したライトマップの焼き込み先
+//テクセルの中心を含む三角形の上の点から半球にレイを飛ばし、結果を足し続ける
+struct Lightmap{
+    int size = 0;
+    std::vector<LightmapTexel> texels; //三角形に覆われたテクセルだけ
+    std::vector<Raytracer::Vec3> sum; //テクセルごとの和(texelsと同じ順)
+    int samples = 0; //テクセルあたりのサンプル数(全テクセルで同じ)
+    std::mt19937 rng{LIGHTMAP_SEED}; //焼き込みの乱数の続き。焼き込み中だけ Raytracer::mt と入れ替える
+
+    //ワールド座標の頂点point,normalとUV(uv,頂点ごとに2個)を持つ三角形triangleをsize四方に展開する
+    //テクセルの中心を含む三角形のうち最初のものがそのテクセルを受け持つ。覆われたテクセルの数を返す
+    int rasterize(int s,const std::vector<Raytracer::Vec3>& point,const std::vector<Raytracer::Vec3>& normal,const float* uv,const std::vector<std::array<int,3>>& triangle){
+        size = s;
+        texels.clear();
+        std::vector<bool> covered(size * size,false);
+
+        for(const auto& tri : triangle){
+            double x[3],y[3];
+            for(int k=0;k<3;k++){
+                x[k] = uv[2*tri[k]+0] * size;
+                y[k] = uv[2*tri[k]+1] * size;
+            }
+            double area = (x[1]-x[0])*(y[2]-y[0]) - (x[2]-x[0])*(y[1]-y[0]);
+            if(std::abs(area) < 1e-12)continue;
+
+            int x0 = std::max(0,(int)std::floor(std::min({x[0],x[1],x[2]})));
+            int x1 = std::min(size-1,(int)std::ceil(std::max({x[0],x[1],x[2]})));
+            int y0 = std::max(0,(int)std::floor(std::min({y[0],y[1],y[2]})));
+            int y1 = std::min(size-1,(int)std::ceil(std::max({y[0],y[1],y[2]})));
+
+            for(int ty=y0;ty<=y1;ty++){
+                for(int tx=x0;tx<=x1;tx++){
+                    int index = ty * size + tx;
+                    if(covered[index])continue;
+
+                    //テクセルの中心の重心座標
+                    double px = tx + 0.5,py = ty + 0.5;
+                    double b1 = ((px-x[0])*(y[2]-y[0]) - (x[2]-x[0])*(py-y[0])) / area;
+                    double b2 = ((x[1]-x[0])*(py-y[0]) - (px-x[0])*(y[1]-y[0])) / area;
+                    double b0 = 1 - b1 - b2;
+                    if(b0 < 0 || b1 < 0 || b2 < 0)continue;
+
+                    Raytracer::Vec3 p = point[tri[0]] * b0 + point[tri[1]] * b1 + point[tri[2]] * b2;
+                    Raytracer::Vec3 n = normal[tri[0]] * b0 + normal[tri[1]] * b1 + normal[tri[2]] * b2;
+                    if(n.length() < 1e-12)continue;
+
+                    covered[index] = true;
+                    texels.push_back({p,Raytracer::normalize(n),index});
+                }
+            }
+        }
+
+        //テクセルをライトマップ上の順に並べ、近い点を続けて追跡する
+        std::sort(texels.begin(),texels.end(),[](const LightmapTexel& a,const LightmapTexel& b){
+            return a.index < b.index;
+        });
+        clear();
+        return texels.size();
+    }
+
+    void clear(){
+        sum.assign(texels.size(),Raytracer::Vec3());
+        samples = 0;
+        rng.seed(LIGHTMAP_SEED);
+    }
+
+    bool empty() const {
+        return size == 0;
+    }
+
+    size_t bytes() const {
+        return texels.capacity() * sizeof(LightmapTexel) + sum.capacity() * sizeof(Raytracer::Vec3);
+    }
+
+    //平均をout(size*size*4, RGBA)に書き出す。Aは覆われたテクセルで1、それ以外は0
+    //dilation回だけ、空のテクセルを覆われた隣(8近傍)の平均で埋めて、UVの継ぎ目のにじみを防ぐ
+    void resolve(float* out,int dilation) const {
+        std::fill(out,out + (size_t)size * size * 4,0.0f);
+        for(int i=0;i<(int)texels.size();i++){
+            Raytracer::Vec3 c = samples > 0 ? sum[i] / samples : Raytracer::Vec3();
+            float* o = out + (size_t)texels[i].index * 4;
+            o[0] = c.x;
+            o[1] = c.y;
+            o[2] = c.z;
+            o[3] = 1;
+        }
+
+        std::vector<float> prev;
+        for(int pass=0;pass<dilation;pass++){
+            prev.assign(out,out + (size_t)size * size * 4);
+            bool grown = false;
+            for(int y=0;y<size;y++){
+                for(int x=0;x<size;x++){
+                    float* o = out + ((size_t)y * size + x) * 4;
+                    if(o[3] > 0)continue;
+                    float r = 0,g = 0,b = 0;
+                    int n = 0;
+                    for(int dy=-1;dy<=1;dy++){
+                        for(int dx=-1;dx<=1;dx++){
+                            int nx = x + dx,ny = y + dy;
+                            if(nx < 0 || ny < 0 || nx >= size || ny >= size)continue;
+                            const float* q = prev.data() + ((size_t)ny * size + nx) * 4;
+                            if(q[3] <= 0)continue;
+                            r += q[0];
+                            g += q[1];
+                            b += q[2];
+                            n++;
+                        }
+                    }
+                    if(n == 0)continue;
+                    //埋めたテクセルのAは0より大きく1未満にして、元から覆われたテクセルと区別する
+                    o[0] = r / n;
+                    o[1] = g / n;
+                    o[2] = b / n;
+                    o[3] = 0.5f;
+                    grown = true;
+                }
+            }
+            if(!grown)break;
+        }
+    }
+};
+
+#endif
@@ -1,16 +1,37 @@
 #include <iostream>
 #include <stdio.h>
 #include <math.h>
+#ifdef __EMSCRIPTEN__
 #include <emscripten/emscripten.h>
+#else
+// ネイティブでビルドするとき (bench.cpp)
+#define EMSCRIPTEN_KEEPALIVE
+#endif
 #include "BVH.hpp"
 #include "stage.hpp"
 #include "raytracer/raytracer.hpp"
+#include "raytracer/denoiser.hpp"
+#include "raytracer/aov.hpp"
+#include "raytracer/tonemap.hpp"
 #include "camera.hpp"
+#include "rasterizer.hpp"
+#include "stats.hpp"
+#include "tile.hpp"
+#include "framebuffer.hpp"
+#include "memory.hpp"
+#include "lightmap.hpp"
+#include "checkpoint.hpp"
 #include <algorithm>
+#include <chrono>
+#include <climits>
+#include <sstream>
 
+// bench.cpp はこのファイルを取り込んで自分の main を使う
+#ifndef RAYTRACER_NO_MAIN
 int main(int argc, char **argv) {
   printf("Hello WASM World\n");
 }
+#endif
 
 #ifdef __cplusplus
 extern "C" {
@@ -23,18 +44,197 @@ struct renderingStream {
     camera cam;
     Stage stage;
     Raytracer::Texture textureManager;
+    Raytracer::PlaneLight light{Raytracer::Vec3(0, 3, 0), 1, Raytracer::Vec3(1.0, 1.0, 1.0) * 10.0};
+    int spp = 10;
+    bool denoise = false;
+    Raytracer::Denoiser denoiser;
+    bool aovs = true; // 最初の交差を G-buffer に書くか (デノイズするときは常に書く)
+    Raytracer::ToneMapper toneMapper; // 描き終えた HDR 画像を表示用の 8bit にする
+    size_t memoryBudget = 0; // 0 なら上限なし
+    int rayBatching = 0; // 0: 画素ごと, 1: タイルごとにまとめて追跡, 2: さらに2段目以降のレイを並べ替える
+    bool rasterize = false; // カメラレイの代わりにラスタライズで最初の交差を求める
+    int previewScale = 0; // 0 以外なら、累積をやり直すパスを 1/previewScale の解像度のプレビューから始める
   } settings;
   struct {
-    int j;
-    std::vector<std::vector<Raytracer::Vec3>> rawPixels;
+    std::vector<Tile> tiles;
+    int tile;
+    std::vector<int> order; // 描画中のタイル内の画素の順番(モートン順)
+    std::vector<VisibilitySample> visibility; // 描画中のタイルの可視性バッファ(画素は行優先、画素ごとに spp 個)
+    int pixelInTile;
+    int pixelsDone;
+    double tileMs;
+    double msPerPixel;
+    int previewLevel; // 描画中のプレビューの縮小率 (1 以下ならプレビューは終わっている)
+    int previewBlock; // 描画中のプレビューの次のブロック(行優先)
+    double msPerBlock;
   } progress;
+  // カメラやシーンが変わったらtrueにして、次のpathTracerで累積をやり直す
+  bool changed = true;
+  // 描画に使う積分器。パスの始めにシーンと設定から選ぶ
+  Raytracer::Integrator integrator;
+  // 解像度が変わらない限り使い回すバッファ
+  Framebuffer frame;
+  // 最後に描き終えたパスの線形 RGB (フィルタとデノイズの後、画素あたり3つの float)
+  // トーンマッピングの設定を変えたら、描き直さずにここから変換し直す
+  struct {
+    int width = 0, height = 0;
+    std::vector<float> rgb;
+  } hdr;
+  // finishStream の作業用領域(平均した画素やデノイズのバッファ)。最後にまとめて捨てる
+  Arena scratch;
+  // bakeLightmap で焼き込み中のライトマップ
+  Lightmap lightmap;
+  // rasterize のときに pathTracer で三角形をタイルに振り分けておく
+  Rasterizer rasterizer;
+  // 描画中に受け付けたシーンの編集
+  // 描画に使っている settings.stage は変えずに、その写しに編集をためておき、パスの区切りで入れ替える
+  std::unique_ptr<Stage> staged;
+  // createCheckpoint で作ったバイト列 (copyCheckpoint で渡したら捨てる)
+  std::vector<uint8_t> checkpoint;
 };
 renderingStream stream;
 
+// ワールド空間で学習したキャッシュを捨て、次のパスで累積をやり直す
+static void resetSceneState() {
+  stream.changed = true;
+  Raytracer::radianceCache.clear();
+  Raytracer::pathGuide.clear();
+}
+
+// ためておいた編集を描画に使うステージにする(描画していないときかパスの区切りで呼ぶ)
+static void commitStagedScene() {
+  if (!stream.staged) return;
+  stream.settings.stage = std::move(*stream.staged);
+  stream.staged.reset();
+  resetSceneState();
+}
+
+// シーンを編集するときのステージ
+// 描画中は描画に使っているステージの写しを返す。BVH はモデルの間で共有しているので、写すのはモデルの表だけ
+static Stage& editStage() {
+  if (!stream.working) {
+    commitStagedScene();
+    return stream.settings.stage;
+  }
+  if (!stream.staged) {
+    stream.staged = std::make_unique<Stage>(stream.settings.stage);
+  }
+  return *stream.staged;
+}
+
+// 編集をすべて反映したステージ(描画とは別の問い合わせに使う)
+static Stage& latestStage() {
+  return stream.staged ? *stream.staged : stream.settings.stage;
+}
+
+// 形状・マテリアル・テクスチャが変わった
+// カメラだけが変わったときと違い、ワールド空間で学習したキャッシュも捨てる
+// 描画中なら描画しているパスはそのまま続け、次のパスの始めに編集と一緒に反映する
+static void markSceneChanged() {
+  if (stream.working) {
+    editStage();
+    return;
+  }
+  resetSceneState();
+}
+
+// 描画に使うステージと設定で要る機能だけを持つ積分器を選ぶ
+// 描画しているステージはパスの区切りでしか変わらないので、パスの始めに選べばよい
+static void selectIntegrator() {
+  stream.integrator = Raytracer::selectIntegrator(stream.settings.stage, stream.settings.aovs || stream.settings.denoise);
+}
+
+// サブシステムごとのメモリ使用量
+static MemoryUsage memoryUsage() {
+  MemoryUsage usage;
+  usage.geometry = latestStage().geometryBytes();
+  usage.bvhNodes = latestStage().nodeBytes();
+  usage.textures = stream.settings.textureManager.bytes();
+  usage.framebuffers = stream.frame.bytes() + (size_t)stream.frame.width * stream.frame.height * 4 * sizeof(int)
+    + stream.hdr.rgb.capacity() * sizeof(float) + stream.lightmap.bytes();
+  usage.scratch = stream.scratch.capacity() + stream.rasterizer.bytes()
+    + stream.progress.visibility.capacity() * sizeof(VisibilitySample) + stream.checkpoint.capacity();
+  usage.caches = Raytracer::radianceCache.bytes() + Raytracer::pathGuide.bytes();
+#ifdef __EMSCRIPTEN__
+  usage.heap = __builtin_wasm_memory_size(0) * 65536;
+#endif
+  usage.budget = stream.settings.memoryBudget;
+  return usage;
+}
+
+// メモリの上限に収まらなければ、収まるまで縦横半分に縮小する(64 四方でも収まらなければ -1)
+// 読み込み後は texture を参照しないので、JS 側で解放してよい
 int EMSCRIPTEN_KEEPALIVE createTexture(int* texture) {
-  return stream.settings.textureManager.set(texture);
+  MemoryUsage usage = memoryUsage();
+  int level = 0;
+  while (!usage.fits(Raytracer::Texture::bytesOf(level))) {
+    if ((TEXTURE_SIZE >> (level + 1)) < 64) return -1;
+    level++;
+  }
+  // テクスチャは後ろに足すだけなので、描画中のパスが参照しているものは変わらない
+  markSceneChanged();
+  return stream.settings.textureManager.set(texture, level);
 }
 
+// 頂点数 vertexCount、ポリゴン数 triangleCount のメッシュを stage に追加し、モデルの番号を返す
+// indexSize はインデックス1個のバイト数(1, 2, 4)、normal と texCoord は nullptr でもよい
+// インデックスが頂点の範囲外なら何も追加せず -1 を返す。メモリの上限は呼び出す側で確かめる
+static int addMesh(
+  Stage& stage,
+  const float* position,
+  int vertexCount,
+  const void* indicies,
+  int triangleCount,
+  int indexSize,
+  const float* normal,
+  const float* texCoord,
+  const float* matrixs,
+  const float* material
+) {
+  if (indexSize != 1 && indexSize != 2 && indexSize != 4) {
+    return -1;
+  }
+
+  std::vector<vert> vertex;
+  vertex.reserve(vertexCount);
+  for (int i=0;i<vertexCount;i += 1) {
+    point3 p{(double)position[3*i+0], (double)position[3*i+1], (double)position[3*i+2]};
+    vec3 n{0, 0, 0};
+    if (normal) n = {(double)normal[3*i+0], (double)normal[3*i+1], (double)normal[3*i+2]};
+    texpoint t{0, 0};
+    if (texCoord) t = {(double)texCoord[2*i+0], (double)texCoord[2*i+1]};
+    vertex.push_back({p,n,t});
+  }
+  
+  std::vector<std::array<int,3>> polygon;
+  polygon.reserve(triangleCount);
+  for (int i=0;i<triangleCount * 3;i += 3) {
+    std::array<int, 3> p;
+    for (int k=0;k<3;k++) {
+      if (indexSize == 1) p[k] = ((const uint8_t*)indicies)[i+k];
+      else if (indexSize == 2) p[k] = ((const uint16_t*)indicies)[i+k];
+      else p[k] = ((const int32_t*)indicies)[i+k];
+      if (p[k] < 0 || p[k] >= vertexCount) return -1;
+    }
+    polygon.push_back(p);
+  }
+
+  if (!normal) {
+    computeNormals(vertex, polygon);
+  }
+
+  std::array<double,16> matr,matrinv;
+  for (int i=0;i < 16;i++) {
+    matr[i] = matrixs[i];
+    matrinv[i] = matrixs[16+i];
+  }
+
+  Raytracer::Material::BaseMaterial *mat = Raytracer::createMaterial((float*)material);
+  return stage.add(std::move(vertex), std::move(polygon),matr,matrinv,mat);
+}
+
+// メッシュを1つステージに追加し、モデルの番号 (setModelTransform などに渡す) を返す
+// メモリの上限を超えるか、インデックスが頂点の範囲外なら何も追加せず -1 を返す
 int EMSCRIPTEN_KEEPALIVE createBounding(
   float* position,
   int posCount,
@@ -47,79 +247,807 @@ int EMSCRIPTEN_KEEPALIVE createBounding(
   float* matrixs,
   float* material
 ) {
-  std::vector<vert> vertex;
   assert(posCount==normCount);
-  for (int i=0;i<posCount;i += 1) {
-    point3 p{(double)position[3*i+0], (double)position[3*i+1], (double)position[3*i+2]};
-    vec3 n{(double)normal[3*i+0], (double)normal[3*i+1], (double)normal[3*i+2]};
-    texpoint t{(double)texCoord[2*i+0], (double)texCoord[2*i+1]};
-    vertex.push_back({p,n,t});
+  Stage& stage = editStage();
+  if (!memoryUsage().fits(stage.estimateBytes(posCount, indexCount))) {
+    return -1;
   }
-  
-  std::vector<std::array<int,3>> polygon;
-  for (int i=0;i<indexCount * 3;i += 3) {
-    std::array<int, 3> p{indicies[i+0], indicies[i+1], indicies[i+2]};
-    polygon.push_back(p);
+  int index = addMesh(stage, position, posCount, indicies, indexCount, 4, normal, texCoord, matrixs, material);
+  if (index < 0) return -1;
+  markSceneChanged();
+
+  return index;
+}
+
+// 複数のメッシュをまとめてステージに追加する
+// table はメッシュごとに MESH_TABLE_STRIDE 個の int を並べたもの
+//   [0] position (float*), [1] 頂点数, [2] indicies, [3] ポリゴン数, [4] インデックスのバイト数(1, 2, 4),
+//   [5] normal (float*, 0なら自動計算), [6] texCoord (float*, 0なら無し), [7] 変換行列と逆行列 (float* 32個),
+//   [8] material (float*), [9] 形状を共有するメッシュのテーブル内の番号 (-1なら新しく作る)
+// 最初に追加したモデルの番号を返す(テーブルの m 番目は first + m 番目のモデルになる)
+// 全部がメモリの上限に収まらないときや、どれかのメッシュのインデックスが不正なときは何も追加せず -1 を返す
+// 写したステージに追加していき、全部追加できたときだけ入れ替える(BVH は共有するので写すのはモデルの表だけ)
+#define MESH_TABLE_STRIDE 10
+int EMSCRIPTEN_KEEPALIVE createMeshes(int count, int* table) {
+  Stage& stage = editStage();
+  size_t required = 0;
+  for (int m = 0; m < count; m++) {
+    const int* e = table + m * MESH_TABLE_STRIDE;
+    if (e[9] < 0 || e[9] >= m) required += stage.estimateBytes(e[1], e[3]);
   }
+  if (!memoryUsage().fits(required)) {
+    return -1;
+  }
+
+  Stage added = stage;
+  const int first = added.size();
+  // テーブル内の番号からモデルの番号へ
+  std::vector<int> modelOf(count);
+  for (int m = 0; m < count; m++) {
+    const int* e = table + m * MESH_TABLE_STRIDE;
+    const float* matrixs = (const float*)(intptr_t)e[7];
+    const float* material = (const float*)(intptr_t)e[8];
+    int source = e[9];
 
+    if (source >= 0 && source < m) {
+      std::array<double,16> matr,matrinv;
+      for (int i=0;i < 16;i++) {
+        matr[i] = matrixs[i];
+        matrinv[i] = matrixs[16+i];
+      }
+      Raytracer::Material::BaseMaterial *mat = Raytracer::createMaterial((float*)material);
+      modelOf[m] = added.addInstance(modelOf[source], matr, matrinv, mat);
+      continue;
+    }
+
+    modelOf[m] = addMesh(
+      added,
+      (const float*)(intptr_t)e[0], e[1],
+      (const void*)(intptr_t)e[2], e[3], e[4],
+      (const float*)(intptr_t)e[5],
+      (const float*)(intptr_t)e[6],
+      matrixs, material
+    );
+    if (modelOf[m] < 0) return -1;
+  }
+
+  stage = std::move(added);
+  markSceneChanged();
+  return first;
+}
+
+// model 番目のモデルの変換を matrixs (変換行列と逆行列の 32 個) に置き換える
+// 描画中でも描画しているパスには影響せず、次のパスから反映する
+int EMSCRIPTEN_KEEPALIVE setModelTransform(int model, float* matrixs) {
+  Stage& stage = editStage();
+  if (model < 0 || model >= stage.size()) {
+    return -1;
+  }
   std::array<double,16> matr,matrinv;
   for (int i=0;i < 16;i++) {
     matr[i] = matrixs[i];
     matrinv[i] = matrixs[16+i];
   }
+  stage.setTransform(model, matr, matrinv);
+  markSceneChanged();
+  return 0;
+}
+
+// model 番目のモデルのマテリアルを material で作り直す(描画中の扱いは setModelTransform と同じ)
+int EMSCRIPTEN_KEEPALIVE setModelMaterial(int model, float* material) {
+  Stage& stage = editStage();
+  if (model < 0 || model >= stage.size()) {
+    return -1;
+  }
+  stage.setMaterial(model, Raytracer::createMaterial(material));
+  markSceneChanged();
+  return 0;
+}
+
+// JS の Camera.dumpAsArray() の 13 個の float からカメラを作る
+static camera readCamera(const float* camData) {
+  camera cam;
+  cam.pos = Raytracer::Vec3{camData[0], camData[1], camData[2]};
+  cam.forward = Raytracer::Vec3{camData[3], camData[4], camData[5]};
+  cam.camUp = Raytracer::Vec3{camData[6], camData[7], camData[8]};
+  cam.camRight = Raytracer::Vec3{camData[9], camData[10], camData[11]};
+  cam.dist = camData[12];
+  return cam;
+}
 
-  Raytracer::Material::BaseMaterial *mat = Raytracer::createMaterial(material);
-  stream.settings.stage.add(vertex, polygon,matr,matrinv,mat);
+int EMSCRIPTEN_KEEPALIVE setCamera(float* camData) {
 
+  camera cam = readCamera(camData);
 
+  if (!cam.equals(stream.settings.cam)) {
+    stream.settings.cam = cam;
+    stream.changed = true;
+  }
   return 0;
 }
 
-int EMSCRIPTEN_KEEPALIVE setCamera(float* camData) {
+int EMSCRIPTEN_KEEPALIVE setDenoise(int enabled, int iterations) {
+  stream.settings.denoise = enabled != 0;
+  if (iterations > 0) {
+    stream.settings.denoiser.iterations = iterations;
+  }
+  // 描画中に有効にしたら、残りの画素から G-buffer を書く
+  if (stream.working) {
+    selectIntegrator();
+  }
+  return 0;
+}
+
+// 最初の交差の AOV (getAOV で読む G-buffer) を書くか。書かなければ陰影計算が少し軽くなる
+// デノイズは G-buffer を使うので、setDenoise で有効にしている間は常に書く
+int EMSCRIPTEN_KEEPALIVE setAOVs(int enabled) {
+  if (stream.working) {
+    return -1;
+  }
+  stream.settings.aovs = enabled != 0;
+  return 0;
+}
+
+int EMSCRIPTEN_KEEPALIVE setSamplesPerPixel(int spp) {
+  if (spp <= 0 || stream.working) {
+    return -1;
+  }
+  stream.settings.spp = spp;
+  return 0;
+}
+
+// これから追加するメッシュのBVHを空間分割ありのSBVHで構築する
+// budget はポリゴン数に対して複製してよい三角形の参照の割合 (0 なら従来の構築)
+// 構築の設定を変えるだけなので、描画中でもステージを写さずにそのまま書き換える
+int EMSCRIPTEN_KEEPALIVE setBVHSpatialSplits(float budget) {
+  stream.settings.stage.setSpatialSplits(budget);
+  if (stream.staged) {
+    stream.staged->setSpatialSplits(budget);
+  }
+  return 0;
+}
+
+// BVHのノードを bits (0, 8, 16) ビットに量子化する。0 なら圧縮しない
+// 既存のモデルも変換するので、レンダリング中は変更できない
+int EMSCRIPTEN_KEEPALIVE setBVHCompression(int bits) {
+  if (stream.working) {
+    return -1;
+  }
+  return editStage().setNodeCompression(bits) ? 0 : -1;
+}
+
+// 直前のレンダリングのAOVを out (width * height * channels) に書き出し、チャンネル数を返す
+int EMSCRIPTEN_KEEPALIVE getAOV(int type, float* out) {
+  if (stream.frame.empty()) {
+    return -1;
+  }
+  int channels = Raytracer::aovChannels(type);
+  for (int p = 0; p < stream.frame.width * stream.frame.height && channels > 0; p++) {
+    Raytracer::writeAOV(stream.frame.averageGBuffer(p), type, out + p * channels);
+  }
+  return channels;
+}
+
+// 描き終えた画像を 8bit にする設定。exposure は段 (EV)、curve は Raytracer::ToneCurve、
+// encoding は Raytracer::OutputEncoding、dither が 0 以外ならベイヤー行列で量子化の誤差を散らす
+// 次に描き終えたときから使い、applyToneMapping で直前の画像にもすぐ反映できる
+int EMSCRIPTEN_KEEPALIVE setToneMapping(float exposure, int curve, int encoding, int dither) {
+  if (!std::isfinite(exposure) || curve < 0 || curve >= Raytracer::TONE_CURVE_COUNT
+    || encoding < 0 || encoding >= Raytracer::OUTPUT_ENCODING_COUNT) {
+    return -1;
+  }
+  stream.settings.toneMapper.configure(exposure, curve, encoding, dither != 0);
+  return 0;
+}
 
-  stream.settings.cam.pos = Raytracer::Vec3{camData[0], camData[1], camData[2]};
-  stream.settings.cam.forward = Raytracer::Vec3{camData[3], camData[4], camData[5]};
-  stream.settings.cam.camUp = Raytracer::Vec3{camData[6], camData[7], camData[8]};
-  stream.settings.cam.camRight = Raytracer::Vec3{camData[9], camData[10], camData[11]};
-  stream.settings.cam.dist = camData[12];
+// 最後に描き終えた HDR 画像を今のトーンマッピングの設定で a (width * height * 4) に変換し直す
+// レイは飛ばさないので、露出を変えたときなどに描き直さずに表示を更新できる
+int EMSCRIPTEN_KEEPALIVE applyToneMapping(int* a) {
+  if (stream.hdr.rgb.empty()) {
+    return -1;
+  }
+  stream.settings.toneMapper.apply(stream.hdr.rgb.data(), stream.hdr.width, stream.hdr.height, a);
   return 0;
 }
 
+// 最後に描き終えた HDR 画像 (width * height * 3 の線形 RGB、行優先で上から) の先頭のアドレスを返し、
+// size に [width, height] を書く。JS 側ではコピーせずに HEAPF32 の上の配列として読める
+// 次に描き終えるまで有効 (まだなければ 0)
+float* EMSCRIPTEN_KEEPALIVE getHDR(int* size) {
+  if (stream.hdr.rgb.empty()) {
+    return nullptr;
+  }
+  size[0] = stream.hdr.width;
+  size[1] = stream.hdr.height;
+  return stream.hdr.rgb.data();
+}
+
+// 2段目以降のレイをまとめて追跡するモード (0: 画素ごと, 1: タイルごと, 2: タイルごとに並べ替え)
+int EMSCRIPTEN_KEEPALIVE setRayBatching(int mode) {
+  if (mode < 0 || mode > 2 || stream.working) {
+    return -1;
+  }
+  stream.settings.rayBatching = mode;
+  return 0;
+}
+
+// カメラレイの最初の交差をラスタライズで求めるか (0: レイを飛ばす, 1: ラスタライズ)
+// ピンホールカメラから見える面はラスタライズで正確に求まるので、2段目からだけレイを飛ばす
+int EMSCRIPTEN_KEEPALIVE setRasterization(int enabled) {
+  if (stream.working) {
+    return -1;
+  }
+  stream.settings.rasterize = enabled != 0;
+  if (!stream.settings.rasterize) {
+    stream.rasterizer.release();
+    std::vector<VisibilitySample>().swap(stream.progress.visibility);
+  }
+  return 0;
+}
+
+// カメラやシーンが変わって累積をやり直すとき、1/scale の解像度を 1spp で描いたプレビューから始めるか
+// scale は 0 (プレビューなし) か 2 から 16 の2の冪。プレビューは縮小率を半分ずつにして描き直し、最後に通常の描画に移る
+// プレビューのサンプルは表示だけに使い、累積バッファには足さない
+int EMSCRIPTEN_KEEPALIVE setPreview(int scale) {
+  if (stream.working || (scale != 0 && (scale < 2 || scale > 16 || (scale & (scale - 1)) != 0))) {
+    return -1;
+  }
+  stream.settings.previewScale = scale;
+  return 0;
+}
+
+// 拡散面の間接光を覚える放射輝度キャッシュを使うか
+// cellSize はワールド座標での格子の幅、blend は更新の重み(大きいほど新しいサンプルに追従する)
+// 2段目以降で学習済みのセルに当たった経路はそこで打ち切るので、経路が短くなる代わりに少し偏る
+int EMSCRIPTEN_KEEPALIVE setRadianceCache(int enabled, float cellSize, float blend) {
+  if (stream.working || (enabled && (cellSize <= 0 || blend <= 0 || blend > 1))) {
+    return -1;
+  }
+  if (enabled) {
+    MemoryUsage usage = memoryUsage();
+    usage.caches = Raytracer::pathGuide.bytes();
+    if (!usage.fits((sizeof(Raytracer::RadianceCache::Cell) << RADIANCE_CACHE_BITS))) {
+      return -1;
+    }
+  }
+  Raytracer::radianceCache.configure(enabled != 0, cellSize, blend);
+  stream.changed = true;
+  return 0;
+}
+
+// 拡散面の反射方向を、学習した方向の分布と BSDF の混合で選ぶパスガイディングを使うか
+// cellSize はワールド座標での格子の幅、fraction は学習した分布から選ぶ確率
+// 学習はパスをまたいで続き、分布は pathTracer を呼ぶたびに作り直す
+int EMSCRIPTEN_KEEPALIVE setPathGuiding(int enabled, float cellSize, float fraction) {
+  if (stream.working || (enabled && (cellSize <= 0 || fraction <= 0 || fraction >= 1))) {
+    return -1;
+  }
+  if (enabled) {
+    MemoryUsage usage = memoryUsage();
+    usage.caches = Raytracer::radianceCache.bytes();
+    if (!usage.fits((sizeof(Raytracer::PathGuide::Cell) << PATH_GUIDE_BITS))) {
+      return -1;
+    }
+  }
+  Raytracer::pathGuide.configure(enabled != 0, cellSize, fraction);
+  stream.changed = true;
+  return 0;
+}
+
+// メモリの上限を MB で設定する (0 なら上限なし)
+// 上限を超えるメッシュや解像度は拒否し、テクスチャは縮小して読み込む
+int EMSCRIPTEN_KEEPALIVE setMemoryBudget(double megabytes) {
+  if (megabytes < 0) {
+    return -1;
+  }
+  stream.settings.memoryBudget = (size_t)(megabytes * 1024 * 1024);
+  return 0;
+}
+
+// サブシステムごとのメモリ使用量をJSON文字列で返す
+const char* EMSCRIPTEN_KEEPALIVE getMemoryUsage() {
+  static std::string json;
+  json = memoryUsage().toJSON();
+  return json.c_str();
+}
+
+// 直前のレンダリングの統計をJSON文字列で返す
+const char* EMSCRIPTEN_KEEPALIVE getStats() {
+  static std::string json;
+  json = renderStats.toJSON();
+  return json.c_str();
+}
+
+// ライトマップを焼き込むメッシュを設定し、2つ目のUV (uv2) で size 四方に展開する
+// position, normal, indicies は model 番目のモデルを作ったときと同じもの(モデル座標)を渡す
+// 覆われたテクセルの数を返す。モデルが無い、ポリゴン数がモデルと違う、インデックスが頂点の範囲外、
+// またはメモリの上限を超えるなら -1
+int EMSCRIPTEN_KEEPALIVE setLightmapTarget(
+  int model,
+  float* position,
+  int vertexCount,
+  int* indicies,
+  int triangleCount,
+  float* normal,
+  float* uv2,
+  int size
+) {
+  Stage& stage = latestStage();
+  if (model < 0 || model >= stage.size() || size <= 0 || vertexCount < 0 || !uv2) {
+    return -1;
+  }
+  // 形状そのものは比べられないので、少なくともポリゴン数がモデルと同じことを確かめる
+  if (triangleCount != stage.modelTriangleCount(model)) {
+    return -1;
+  }
+  size_t required = (size_t)size * size * (sizeof(LightmapTexel) + sizeof(Raytracer::Vec3));
+  if (!memoryUsage().fits(required)) {
+    return -1;
+  }
+
+  std::vector<std::array<int,3>> polygon(triangleCount);
+  for (int i = 0; i < triangleCount; i++) {
+    polygon[i] = {indicies[3*i+0], indicies[3*i+1], indicies[3*i+2]};
+    for (int k = 0; k < 3; k++) {
+      if (polygon[i][k] < 0 || polygon[i][k] >= vertexCount) return -1;
+    }
+  }
+
+  std::vector<vert> vertex(vertexCount);
+  for (int i = 0; i < vertexCount; i++) {
+    vertex[i].point = {position[3*i+0], position[3*i+1], position[3*i+2]};
+    if (normal) vertex[i].norm = {normal[3*i+0], normal[3*i+1], normal[3*i+2]};
+  }
+  if (!normal) {
+    computeNormals(vertex, polygon);
+  }
+
+  std::vector<Raytracer::Vec3> worldPoint(vertexCount), worldNormal(vertexCount);
+  for (int i = 0; i < vertexCount; i++) {
+    point3 p = stage.pointToWorld(model, vertex[i].point);
+    vec3 n = stage.normalToWorld(model, vertex[i].norm);
+    worldPoint[i] = Raytracer::Vec3(p.x, p.y, p.z);
+    worldNormal[i] = Raytracer::Vec3(n.x, n.y, n.z);
+  }
+
+  return stream.lightmap.rasterize(size, worldPoint, worldNormal, uv2, polygon);
+}
+
+// 設定したライトマップの全テクセルに samples サンプルずつ足し、テクセルあたりの合計サンプル数を返す
+// 何度も呼べば少しずつ収束する。mode 0: raytrace による放射照度 / π (光源と間接光を含む)
+// mode 1: 遮蔽 (AO)。aoDistance より近くに何かあれば暗くする (0 以下なら距離を問わない)
+// 乱数はライトマップ自身の列を使うので、描画中のパスの乱数の続き(チェックポイントの再現性)は変えない
+int EMSCRIPTEN_KEEPALIVE bakeLightmap(int mode, int samples, float aoDistance) {
+  Lightmap& lightmap = stream.lightmap;
+  if (lightmap.empty() || mode < 0 || mode > 1 || samples <= 0) {
+    return -1;
+  }
+  Stage& stage = latestStage();
+  double aoRange = aoDistance > 0 ? aoDistance : INFF;
+  Raytracer::Integrator integrator = Raytracer::selectIntegrator(stage, false);
+
+  std::swap(Raytracer::mt, lightmap.rng);
+  for (int i = 0; i < (int)lightmap.texels.size(); i++) {
+    const LightmapTexel& texel = lightmap.texels[i];
+    Raytracer::Vec3 s, t;
+    Raytracer::orthonormalBasis(texel.normal, s, t);
+    // 面から少し浮かせて、自分自身との交差を避ける
+    Raytracer::Vec3 origin = texel.point + texel.normal * MINIMUM_INTERSECT_DISTANCE;
+
+    for (int k = 0; k < samples; k++) {
+      // cos に比例した半球の方向 (局所座標では y が法線)
+      double u = Raytracer::rnd(), v = Raytracer::rnd();
+      double r = std::sqrt(u), phi = 2 * M_PI * v;
+      Raytracer::Vec3 local(r * std::cos(phi), std::sqrt(std::max(0.0, 1 - u)), r * std::sin(phi));
+      Raytracer::Vec3 dir = normalize(Raytracer::localToWorld(local, s, texel.normal, t));
+
+      if (mode == 0) {
+        Raytracer::Ray ray(origin, dir);
+        lightmap.sum[i] += integrator.raytrace(ray, stage, stream.settings.textureManager, stream.settings.light).rgb;
+      } else if (!stage.occludedStage(origin.toPoint3(), dir.toVec3(), MINIMUM_INTERSECT_DISTANCE, aoRange)) {
+        lightmap.sum[i] += Raytracer::Vec3(1.0);
+      }
+    }
+  }
+  std::swap(Raytracer::mt, lightmap.rng);
+  lightmap.samples += samples;
+  return lightmap.samples;
+}
+
+// 焼き込んだライトマップを out (size * size * 4, RGBA) に書き出し、テクセルあたりのサンプル数を返す
+// A は覆われたテクセルで 1、dilation 回の膨張で埋めたテクセルで 0.5、それ以外は 0
+int EMSCRIPTEN_KEEPALIVE readLightmap(float* out, int dilation) {
+  if (stream.lightmap.empty()) {
+    return -1;
+  }
+  stream.lightmap.resolve(out, dilation);
+  return stream.lightmap.samples;
+}
+
+// count 本のレイの最も近い交差をまとめて求める (物理ベースでない用途: ピッキング、可視性、音響など)
+// rays は SoA で [ox, oy, oz, dx, dy, dz, tMin, tMax] の各 count 個 (t は d の長さを単位とする)
+// hits に [t, u, v]、ids に [model, prim] を各 count 個書き出す。外れたレイは t = -1、ids = -1
+// prim は createBounding / createMeshes に渡したポリゴンの番号。当たったレイの数を返す
+int EMSCRIPTEN_KEEPALIVE intersectRays(int count, float* rays, float* hits, int* ids) {
+  if (count < 0) {
+    return -1;
+  }
+  const float *ox = rays, *oy = rays + count, *oz = rays + count * 2;
+  const float *dx = rays + count * 3, *dy = rays + count * 4, *dz = rays + count * 5;
+  const float *tMin = rays + count * 6, *tMax = rays + count * 7;
+  Stage& stage = latestStage();
+  int hitCount = 0;
+  for (int i = 0; i < count; i++) {
+    stageHit h = stage.intersectStageClosest({ox[i], oy[i], oz[i]}, {dx[i], dy[i], dz[i]}, tMin[i], tMax[i]);
+    if (h.isHit) {
+      hits[i] = h.t;
+      hits[count + i] = h.u;
+      hits[count * 2 + i] = h.v;
+      ids[i] = h.model;
+      ids[count + i] = stage.polygonOf(h.model, h.prim);
+      hitCount++;
+    } else {
+      hits[i] = -1;
+      hits[count + i] = 0;
+      hits[count * 2 + i] = 0;
+      ids[i] = -1;
+      ids[count + i] = -1;
+    }
+  }
+  return hitCount;
+}
+
+// count 本のレイが [tMin, tMax] で何かに遮られるかをまとめて調べ、occluded に 0/1 を書き出す
+// rays の並びは intersectRays と同じ。最初に見つかった交差で打ち切るので最も近い交差より速い
+// 遮られたレイの数を返す
+int EMSCRIPTEN_KEEPALIVE occludedRays(int count, float* rays, int* occluded) {
+  if (count < 0) {
+    return -1;
+  }
+  const float *ox = rays, *oy = rays + count, *oz = rays + count * 2;
+  const float *dx = rays + count * 3, *dy = rays + count * 4, *dz = rays + count * 5;
+  const float *tMin = rays + count * 6, *tMax = rays + count * 7;
+  Stage& stage = latestStage();
+  int occludedCount = 0;
+  for (int i = 0; i < count; i++) {
+    occluded[i] = stage.occludedStage({ox[i], oy[i], oz[i]}, {dx[i], dy[i], dz[i]}, tMin[i], tMax[i]);
+    occludedCount += occluded[i];
+  }
+  return occludedCount;
+}
+
+// 画素 index にサンプルの和を足し、平均を a に書き出す
+static void storePixel(int* a, int index, const Raytracer::Vec3& rgb, const Raytracer::GBufferSample& gbuffer) {
+  stream.frame.add(index, rgb, gbuffer, stream.settings.spp);
+  Raytracer::Vec3 resultRgb = stream.frame.averageColor(index);
+  a[index * 4 + 0] = resultRgb.x * 255;
+  a[index * 4 + 1] = resultRgb.y * 255;
+  a[index * 4 + 2] = resultRgb.z * 255;
+  a[index * 4 + 3] = 255;
+}
+
+// 描画中のタイルの local 番目(モートン順)の画素の画面上の番号
+static int tilePixel(const Tile& tile, int local) {
+  int p = stream.progress.order[local];
+  return (tile.y + p / tile.width) * stream.settings.width + tile.x + p % tile.width;
+}
+
+// タイルの local 番目から count 画素(PIXEL_GROUP 以下)を、サンプルを画素の間で交互に回して描画する
+// 近くの画素の同じ番目のサンプルが続くので、カメラレイが同じノードをたどりやすい
+static void renderPixels(int* a, const Tile& tile, int local, int count) {
+  int width = stream.settings.width, height = stream.settings.height;
+  const int spp = stream.settings.spp;
+
+  Raytracer::Vec3 resultRgb[PIXEL_GROUP];
+  Raytracer::GBufferSample resultGBuffer[PIXEL_GROUP];
+  for(int s = 0; s < spp; s++) {
+    for(int p = 0; p < count; p++) {
+      Raytracer::GBufferSample gbuffer{};
+      long long traversalCost = renderStats.traversalCost();
+      if (stream.settings.rasterize) {
+        const VisibilitySample& sample = stream.progress.visibility[stream.progress.order[local + p] * spp + s];
+        Raytracer::Ray ray(stream.settings.cam.pos, sample.dir);
+        resultRgb[p] += stream.integrator.raytrace(ray, sample.hit, stream.settings.stage, stream.settings.textureManager, stream.settings.light, &gbuffer).rgb;
+      } else {
+        int index = tilePixel(tile, local + p);
+        int i = index % width, j = index / width;
+        // heightを1とした正規化
+        Raytracer::Ray ray = stream.settings.cam.getRay(
+          (double(i) + Raytracer::rnd() - width / 2) / height,
+          -(double(j) + Raytracer::rnd() - height / 2) / height);
+        resultRgb[p] += stream.integrator.raytrace(ray, stream.settings.stage,stream.settings.textureManager, stream.settings.light, &gbuffer).rgb;
+      }
+      gbuffer.traversalCost = renderStats.traversalCost() - traversalCost;
+      resultGBuffer[p] += gbuffer;
+    }
+  }
+
+  for(int p = 0; p < count; p++) {
+    storePixel(a, tilePixel(tile, local + p), resultRgb[p], resultGBuffer[p]);
+  }
+}
+
+// タイルの local 番目から count 画素の全サンプルの経路をまとめて追跡する
+static void renderTileBatch(int* a, const Tile& tile, int local, int count) {
+  int width = stream.settings.width, height = stream.settings.height;
+  const int spp = stream.settings.spp;
+
+  // 経路はサンプル番号ごとに、画素をモートン順に並べる
+  Arena::Marker marker = stream.scratch.mark();
+  Raytracer::PathState* paths = stream.scratch.make<Raytracer::PathState>(count * spp);
+  stageHit* firstHits = nullptr;
+  if (stream.settings.rasterize) {
+    firstHits = stream.scratch.make<stageHit>(count * spp);
+    for(int s = 0; s < spp; s++) {
+      for(int p = 0; p < count; p++) {
+        const VisibilitySample& sample = stream.progress.visibility[stream.progress.order[local + p] * spp + s];
+        paths[s * count + p].ray = Raytracer::Ray(stream.settings.cam.pos, sample.dir);
+        firstHits[s * count + p] = sample.hit;
+      }
+    }
+  } else {
+    for(int s = 0; s < spp; s++) {
+      for(int p = 0; p < count; p++) {
+        int index = tilePixel(tile, local + p);
+        int i = index % width, j = index / width;
+        // heightを1とした正規化
+        paths[s * count + p].ray = stream.settings.cam.getRay(
+          (double(i) + Raytracer::rnd() - width / 2) / height,
+          -(double(j) + Raytracer::rnd() - height / 2) / height);
+      }
+    }
+  }
+
+  stream.integrator.traceBatch(paths, count * spp, stream.settings.stage, stream.settings.textureManager,
+    stream.settings.light, stream.settings.rayBatching == 2, stream.scratch, firstHits);
+
+  for(int p = 0; p < count; p++) {
+    Raytracer::Vec3 resultRgb{};
+    Raytracer::GBufferSample resultGBuffer{};
+    for(int s = 0; s < spp; s++) {
+      resultRgb += paths[s * count + p].radiance;
+      resultGBuffer += paths[s * count + p].gbuffer;
+    }
+    storePixel(a, tilePixel(tile, local + p), resultRgb, resultGBuffer);
+  }
+  stream.scratch.rewind(marker);
+}
+
+// 描画を始めるタイルの全画素・全サンプルの向きを決め、ラスタライズして可視性バッファを作る
+static void rasterizeTile(const Tile& tile) {
+  int width = stream.settings.width, height = stream.settings.height;
+  const int spp = stream.settings.spp;
+
+  std::vector<VisibilitySample>& visibility = stream.progress.visibility;
+  visibility.resize(tile.width * tile.height * spp);
+  for(int y = 0; y < tile.height; y++) {
+    for(int x = 0; x < tile.width; x++) {
+      int i = tile.x + x, j = tile.y + y;
+      for(int s = 0; s < spp; s++) {
+        VisibilitySample& sample = visibility[(y * tile.width + x) * spp + s];
+        // heightを1とした正規化
+        sample.dir = stream.settings.cam.getRay(
+          (double(i) + Raytracer::rnd() - width / 2) / height,
+          -(double(j) + Raytracer::rnd() - height / 2) / height).dir;
+        sample.hit = {false, INFF, -1, -1, -1, -1};
+      }
+    }
+  }
+  stream.rasterizer.rasterize(stream.progress.tile, tile, spp, MINIMUM_INTERSECT_DISTANCE, visibility.data());
+}
+
+// タイル順に最大 maxPixels 画素、または budgetMs ミリ秒を使い切る直前まで描画する
+// budgetMs <= 0 なら時間制限なし
+// rayBatching が有効なら、タイルの残りをまとめて1回で描画する
+static void renderTiles(int* a, int maxPixels, double budgetMs) {
+  auto start = std::chrono::steady_clock::now();
+  auto elapsedMs = [&]() {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+  };
+
+  int rendered = 0;
+  while(stream.progress.tile < (int)stream.progress.tiles.size() && rendered < maxPixels){
+    const Tile& tile = stream.progress.tiles[stream.progress.tile];
+    int local = stream.progress.pixelInTile;
+    if(local == 0){
+      stream.progress.order = mortonOrder(tile.width, tile.height);
+      if(stream.settings.rasterize){
+        auto rasterStart = std::chrono::steady_clock::now();
+        rasterizeTile(tile);
+        stream.progress.tileMs += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - rasterStart).count();
+      }
+    }
+    int remaining = tile.width * tile.height - local;
+    int count = stream.settings.rayBatching ? remaining : std::min(PIXEL_GROUP, remaining);
+
+    // 1画素あたりの平均時間から、次の描画で予算を超えそうなら止める(最低1回は進める)
+    if(budgetMs > 0 && rendered > 0 && elapsedMs() + stream.progress.msPerPixel * count > budgetMs){
+      break;
+    }
+
+    auto pixelStart = std::chrono::steady_clock::now();
+    if(stream.settings.rayBatching){
+      renderTileBatch(a, tile, local, count);
+    }else{
+      renderPixels(a, tile, local, count);
+    }
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - pixelStart).count();
+    double pixelMs = ms / count;
+
+    // 指数移動平均
+    stream.progress.msPerPixel = stream.progress.pixelsDone == 0 ? pixelMs : stream.progress.msPerPixel * 0.9 + pixelMs * 0.1;
+    stream.progress.tileMs += ms;
+    stream.progress.pixelsDone += count;
+    rendered += count;
+
+    if((stream.progress.pixelInTile += count) >= tile.width * tile.height){
+#ifdef RAYTRACER_STATS
+      renderStats.tiles.push_back({tile.x, tile.y, tile.width, tile.height, stream.progress.tileMs});
+#endif
+      stream.progress.tile++;
+      stream.progress.pixelInTile = 0;
+      stream.progress.tileMs = 0;
+    }
+  }
+}
+
+// 縮小率 level のプレビューの block 番目のブロックを1サンプルで描き、ブロックの全画素に書く
+static void renderPreviewBlock(int* a, int level, int block) {
+  int width = stream.settings.width, height = stream.settings.height;
+  int blocksX = (width + level - 1) / level;
+  int x0 = block % blocksX * level, y0 = block / blocksX * level;
+  int x1 = std::min(x0 + level, width), y1 = std::min(y0 + level, height);
+
+  // ブロックの中の1点を選ぶ(heightを1とした正規化)
+  Raytracer::Ray ray = stream.settings.cam.getRay(
+    (x0 + Raytracer::rnd() * (x1 - x0) - width / 2) / height,
+    -(y0 + Raytracer::rnd() * (y1 - y0) - height / 2) / height);
+  Raytracer::Vec3 rgb = stream.integrator.raytrace(ray, stream.settings.stage, stream.settings.textureManager, stream.settings.light).rgb;
+
+  for(int y = y0; y < y1; y++) {
+    for(int x = x0; x < x1; x++) {
+      int index = y * width + x;
+      a[index * 4 + 0] = rgb.x * 255;
+      a[index * 4 + 1] = rgb.y * 255;
+      a[index * 4 + 2] = rgb.z * 255;
+      a[index * 4 + 3] = 255;
+    }
+  }
+}
+
+// プレビューを描く。最も粗い段は時間に関わらず描き切るので、カメラを動かしてから最初の表示までの時間はこの段で決まる
+// それより細かい段は budgetMs ミリ秒を使い切る直前まで描き、budgetMs <= 0 なら1回に1段ずつ描く
+static void renderPreview(int* a, double budgetMs) {
+  auto start = std::chrono::steady_clock::now();
+  auto elapsedMs = [&]() {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+  };
+
+  int width = stream.settings.width, height = stream.settings.height;
+  int rendered = 0;
+  while(stream.progress.previewLevel > 1){
+    int level = stream.progress.previewLevel;
+    int blocks = ((width + level - 1) / level) * ((height + level - 1) / level);
+    bool coarsest = level == stream.settings.previewScale;
+    while(stream.progress.previewBlock < blocks){
+      if(!coarsest && budgetMs > 0 && rendered > 0 && elapsedMs() + stream.progress.msPerBlock > budgetMs){
+        return;
+      }
+      auto blockStart = std::chrono::steady_clock::now();
+      renderPreviewBlock(a, level, stream.progress.previewBlock++);
+      double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - blockStart).count();
+      stream.progress.msPerBlock = rendered == 0 && coarsest ? ms : stream.progress.msPerBlock * 0.9 + ms * 0.1;
+      rendered++;
+    }
+    stream.progress.previewLevel /= 2;
+    stream.progress.previewBlock = 0;
+    if(budgetMs <= 0) return;
+  }
+}
+
+// 分散レンダリング用: width*height の画面のうち (x, y) から w*h の領域を spp サンプルずつ描き、
+// 画素ごとに [R, G, B の和, サンプル数] を out (w*h*4) に書き出す。累積バッファには足さない
+// 乱数は seed から始めるので、同じシーン・カメラ・引数なら、どのワーカーで何度描いても同じ結果になる
+// (放射輝度キャッシュとパスガイディングは学習の状態で結果が変わるので、使うなら無効にしておく)
+// カメラは camData (setCamera と同じ並び) をこの呼び出しだけで使い、setCamera のカメラと累積はそのまま残す
+int EMSCRIPTEN_KEEPALIVE renderRegion(float* camData, int width, int height, int x, int y, int w, int h, int spp, int seed, float* out) {
+  if (stream.working || spp <= 0 || w <= 0 || h <= 0 || x < 0 || y < 0 || x + w > width || y + h > height) {
+    return -1;
+  }
+  commitStagedScene();
+  Raytracer::Integrator integrator = Raytracer::selectIntegrator(stream.settings.stage, false);
+  camera cam = readCamera(camData);
+
+  // 描画中でないパスの乱数の続きは変えない
+  std::mt19937 saved = Raytracer::mt;
+  Raytracer::mt.seed((uint32_t)seed);
+  std::vector<int> order = mortonOrder(w, h);
+  for (int p : order) {
+    int i = x + p % w, j = y + p / w;
+    Raytracer::Vec3 sum{};
+    for (int s = 0; s < spp; s++) {
+      // heightを1とした正規化
+      Raytracer::Ray ray = cam.getRay(
+        (double(i) + Raytracer::rnd() - width / 2) / height,
+        -(double(j) + Raytracer::rnd() - height / 2) / height);
+      sum += integrator.raytrace(ray, stream.settings.stage, stream.settings.textureManager, stream.settings.light).rgb;
+    }
+    out[p * 4 + 0] = sum.x;
+    out[p * 4 + 1] = sum.y;
+    out[p * 4 + 2] = sum.z;
+    out[p * 4 + 3] = spp;
+  }
+  Raytracer::mt = saved;
+  return w * h;
+}
+
+// 進捗を info に書き出す
+// [0]: 完了画素数, [1]: 全画素数, [2]: 完了サンプル数, [3]: 残り時間の推定(ms)
+static void writeProgress(float* info) {
+  if(!info) return;
+  int total = stream.settings.width * stream.settings.height;
+  info[0] = stream.progress.pixelsDone;
+  info[1] = total;
+  info[2] = (double)stream.progress.pixelsDone * stream.settings.spp;
+  info[3] = stream.progress.msPerPixel * (total - stream.progress.pixelsDone);
+}
+
+static int finishStream(int* a);
+static void startPass();
+
 int EMSCRIPTEN_KEEPALIVE readStream(int* a){
   if(!stream.working) {
     return -1;
   }
+  // 描画中にカメラやシーンが変わったら、残りを捨ててやり直す
+  if(stream.changed) {
+    startPass();
+  }
 
-  int width = stream.settings.width, height = stream.settings.height;
   const int lineperupdate = 10;
 
-  if(stream.progress.j < stream.settings.height){
-      int j;
-      for(j = stream.progress.j; j < height && j < stream.progress.j + lineperupdate; j++){
-          for(int i = 0; i < width; i++){
-              const int spp = 10;
-              Raytracer::Vec3 resultRgb{};
-              for(int s = 0; s < spp; s++) {
-                  // heightを1とした正規化
-                  Raytracer::Ray ray = stream.settings.cam.getRay(
-                    (double(i) + Raytracer::rnd() - width / 2) / height,
-                    -(double(j) + Raytracer::rnd() - height / 2) / height);
-                  resultRgb += Raytracer::raytrace(ray, stream.settings.stage,stream.settings.textureManager).rgb;
-              }
-              resultRgb *= (double(1.0) / spp);
-
-              stream.progress.rawPixels[j][i] = resultRgb;
-              int index = j * width + i;
-              a[index * 4 + 0] = resultRgb.x * 255;
-              a[index * 4 + 1] = resultRgb.y * 255;
-              a[index * 4 + 2] = resultRgb.z * 255;
-              a[index * 4 + 3] = 255;
-          }
-      }
-      stream.progress.j = j;
+  if(stream.progress.previewLevel > 1){
+      renderPreview(a, 0);
+      return 1;
+  }
+
+  if(stream.progress.tile < (int)stream.progress.tiles.size()){
+      renderTiles(a, lineperupdate * stream.settings.width, 0);
       return 1;
   }
 
+  return finishStream(a);
+}
+
+// 時間予算つきの readStream
+// budgetMs ミリ秒を使い切る直前まで描画し、進捗を info (float 4個) に書き出す
+int EMSCRIPTEN_KEEPALIVE readStreamFor(int* a, double budgetMs, float* info){
+  if(!stream.working) {
+    return -1;
+  }
+  if(stream.changed) {
+    startPass();
+  }
+
+  if(stream.progress.previewLevel > 1){
+      renderPreview(a, budgetMs);
+      writeProgress(info);
+      return 1;
+  }
+
+  if(stream.progress.tile < (int)stream.progress.tiles.size()){
+      renderTiles(a, INT_MAX, budgetMs);
+      writeProgress(info);
+      return 1;
+  }
+
+  int result = finishStream(a);
+  writeProgress(info);
+  return result;
+}
+
+static int finishStream(int* a){
+  int width = stream.settings.width, height = stream.settings.height;
 
   // 3x3 gaussian
   // constexpr int kernelW = 3, kernelH = 3;
@@ -132,8 +1060,23 @@ int EMSCRIPTEN_KEEPALIVE readStream(int* a){
   double filterKernel[kernelW][kernelH] = {
     {1.0}
   };
-  const double gamma = 1/2.2;
 
+  Raytracer::Vec3* resolved = stream.scratch.make<Raytracer::Vec3>(width * height);
+  Raytracer::GBufferSample* resolvedGBuffer = stream.scratch.make<Raytracer::GBufferSample>(width * height);
+  for(int p = 0; p < width * height; p++){
+    resolved[p] = stream.frame.averageColor(p);
+    resolvedGBuffer[p] = stream.frame.averageGBuffer(p);
+  }
+  const Raytracer::Vec3* source = resolved;
+  if (stream.settings.denoise) {
+    Raytracer::Vec3* denoised = stream.scratch.make<Raytracer::Vec3>(width * height);
+    stream.settings.denoiser.apply(resolved, resolvedGBuffer, width, height, denoised, stream.scratch);
+    source = denoised;
+  }
+
+  stream.hdr.width = width;
+  stream.hdr.height = height;
+  stream.hdr.rgb.resize((size_t)width * height * 3);
   for(int j = 0; j < height; j++){
     for(int i = 0; i < width; i++){
       Raytracer::Vec3 resultRgb{};
@@ -142,36 +1085,77 @@ int EMSCRIPTEN_KEEPALIVE readStream(int* a){
         for(int dy = 0; dy < kernelH; dy++){
           int sx = std::clamp(i + dx - kernelW / 2, 0, width - 1);
           int sy = std::clamp(j + dy - kernelH / 2, 0, height - 1);
-          resultRgb += filterKernel[dx][dy] * stream.progress.rawPixels[sy][sx];
+          resultRgb += filterKernel[dx][dy] * source[sy * width + sx];
         }
       }
-      resultRgb.x = pow(resultRgb.x, gamma);
-      resultRgb.y = pow(resultRgb.y, gamma);
-      resultRgb.z = pow(resultRgb.z, gamma);
 
       int index = j * width + i;
-      a[index * 4 + 0] = resultRgb.x * 255;
-      a[index * 4 + 1] = resultRgb.y * 255;
-      a[index * 4 + 2] = resultRgb.z * 255;
-      a[index * 4 + 3] = 255;
+      stream.hdr.rgb[index * 3 + 0] = resultRgb.x;
+      stream.hdr.rgb[index * 3 + 1] = resultRgb.y;
+      stream.hdr.rgb[index * 3 + 2] = resultRgb.z;
     }
   }
-  
+  stream.settings.toneMapper.apply(stream.hdr.rgb.data(), width, height, a);
+
+  stream.scratch.reset();
   stream.working = false;
   return 0;
 }
 
+// settings.width, height で1パス分の描画を始める(描画中に呼ぶと最初からやり直す)
+static void startPass(){
+    int width = stream.settings.width, height = stream.settings.height;
+    // 前のパスの間にためておいた編集をここで入れ替える
+    commitStagedScene();
+    selectIntegrator();
+    // 解像度もカメラもシーンも同じなら前回の結果にサンプルを足していく
+    bool restart = stream.frame.resize(width, height) || stream.changed;
+    if (restart) {
+      stream.frame.clear();
+    }
+    stream.changed = false;
+    stream.progress.tiles = makeTiles(width, height);
+    stream.progress.tile = 0;
+    stream.progress.pixelInTile = 0;
+    stream.progress.pixelsDone = 0;
+    stream.progress.tileMs = 0;
+    stream.progress.msPerPixel = 0;
+    stream.progress.previewLevel = restart ? stream.settings.previewScale : 0;
+    stream.progress.previewBlock = 0;
+    stream.progress.msPerBlock = 0;
+    if (Raytracer::pathGuide.enabled) {
+      Raytracer::pathGuide.refresh();
+    }
+    if (stream.settings.rasterize) {
+      stream.rasterizer.bin(stream.settings.stage, stream.settings.cam, width, height);
+    }
+    renderStats.reset();
+    renderStats.triangles = stream.settings.stage.triangleCount();
+    renderStats.references = stream.settings.stage.referenceCount();
+    renderStats.geometryBytes = stream.settings.stage.geometryBytes();
+    renderStats.bvhNodeBytes = stream.settings.stage.nodeBytes();
+    renderStats.bvhNodeBits = stream.settings.stage.compressionBits();
+}
+
 int EMSCRIPTEN_KEEPALIVE pathTracer(int* a, int width, int height){
     if(stream.working){
       return -1;
     }
+    // 解像度を変えるときは、累積バッファ、HDR 画像と画素の配列が上限に収まるか確かめる
+    if (width != stream.frame.width || height != stream.frame.height) {
+      MemoryUsage usage = memoryUsage();
+      usage.framebuffers = 0;
+      usage.scratch = 0;
+      if (!usage.fits(Framebuffer::bytesOf(width, height) + (size_t)width * height * (4 * sizeof(int) + 3 * sizeof(float)))) {
+        return -1;
+      }
+      stream.scratch.release();
+    }
     stream.working = true;
 
     stream.settings.width = width;
     stream.settings.height = height;
-    stream.progress.rawPixels.clear();
-    stream.progress.rawPixels.assign(height, std::vector<Raytracer::Vec3>(width));
-    stream.progress.j = 0;
+    startPass();
 
     for(int i = 0; i < width * height * 4; i++)
       a[i] = 255;
@@ -179,6 +1163,193 @@ int EMSCRIPTEN_KEEPALIVE pathTracer(int* a, int width, int height){
     return 0;
 }
 
+// チェックポイント: 累積バッファ、画素ごとのサンプル数、乱数の状態と学習したキャッシュを保存し、
+// 同じシーンと設定で読み戻すと、止めずに描いた場合と1ビットも変わらない結果の続きを描ける
+#define CHECKPOINT_MAGIC 0x4B435452 // "RTCK"
+#define CHECKPOINT_VERSION 1
+
+// 今チェックポイントを作れるか
+// パスの間か、描画中のパスでプレビューを描き終えた後ならどこでも作れる
+// ただしラスタライズでは、タイルの可視性バッファを保存しないのでタイルの区切りに限る
+static bool atCheckpointBoundary() {
+  if (stream.staged) return false;
+  if (!stream.working) return true;
+  return !stream.changed && stream.progress.previewLevel <= 1
+    && (!stream.settings.rasterize || stream.progress.pixelInTile == 0);
+}
+
+// 今の状態をチェックポイントのバイト列にしてバイト数を返す。作れない時点なら -1
+// バイト列は copyCheckpoint で受け取る
+int EMSCRIPTEN_KEEPALIVE createCheckpoint() {
+  if (!atCheckpointBoundary()) {
+    return -1;
+  }
+  CheckpointWriter w;
+  w.put((uint32_t)CHECKPOINT_MAGIC);
+  w.put((uint32_t)CHECKPOINT_VERSION);
+
+  // 読み戻すときに同じでなければならない設定とシーンの大きさ
+  w.put(stream.frame.width);
+  w.put(stream.frame.height);
+  w.put(stream.settings.spp);
+  w.put(stream.settings.rayBatching);
+  w.put((uint8_t)stream.settings.rasterize);
+  w.put(stream.settings.stage.triangleCount());
+
+  w.put(stream.settings.cam);
+  w.put((uint8_t)stream.changed);
+  w.put((uint8_t)stream.working);
+  w.put(stream.progress.tile);
+  w.put(stream.progress.pixelInTile);
+  w.put(stream.progress.pixelsDone);
+
+  std::ostringstream rng;
+  rng << Raytracer::mt;
+  w.putString(rng.str());
+
+  w.putArray(stream.frame.color);
+  w.putArray(stream.frame.gbuffer);
+  w.putArray(stream.frame.samples);
+
+  w.put((uint8_t)Raytracer::radianceCache.enabled);
+  if (Raytracer::radianceCache.enabled) {
+    w.put(Raytracer::radianceCache.cellSize);
+    w.put(Raytracer::radianceCache.blend);
+    w.putArray(Raytracer::radianceCache.cells);
+  }
+  w.put((uint8_t)Raytracer::pathGuide.enabled);
+  if (Raytracer::pathGuide.enabled) {
+    w.put(Raytracer::pathGuide.cellSize);
+    w.put(Raytracer::pathGuide.fraction);
+    w.putArray(Raytracer::pathGuide.cells);
+  }
+
+  stream.checkpoint = std::move(w.bytes);
+  return stream.checkpoint.size();
+}
+
+// createCheckpoint で作ったバイト列を out (4 バイト単位に切り上げた大きさ) に書き出し、バイト数を返す
+int EMSCRIPTEN_KEEPALIVE copyCheckpoint(int* out) {
+  if (stream.checkpoint.empty()) {
+    return -1;
+  }
+  int bytes = stream.checkpoint.size();
+  std::memcpy(out, stream.checkpoint.data(), bytes);
+  std::vector<uint8_t>().swap(stream.checkpoint);
+  return bytes;
+}
+
+// createCheckpoint で作った bytes バイトの data を読み戻す
+// シーン、spp、レイのまとめ方、ラスタライズ、キャッシュの設定は作ったときと同じにしておくこと(違えば -1)
+// カメラは読み戻す。描画中のパスで作ったものなら、そのパスの続きから readStream で描ける
+int EMSCRIPTEN_KEEPALIVE loadCheckpoint(int* data, int bytes) {
+  if (stream.working || bytes < 0) {
+    return -1;
+  }
+  commitStagedScene();
+
+  CheckpointReader r((const uint8_t*)data, bytes);
+  if (r.get<uint32_t>() != CHECKPOINT_MAGIC || r.get<uint32_t>() != CHECKPOINT_VERSION) {
+    return -1;
+  }
+  int width = r.get<int>(), height = r.get<int>();
+  int spp = r.get<int>(), rayBatching = r.get<int>();
+  bool rasterize = r.get<uint8_t>() != 0;
+  long long triangles = r.get<long long>();
+  if (!r.ok || width < 0 || height < 0 || spp != stream.settings.spp || rayBatching != stream.settings.rayBatching
+    || rasterize != stream.settings.rasterize || triangles != stream.settings.stage.triangleCount()) {
+    return -1;
+  }
+
+  camera cam = r.get<camera>();
+  bool changed = r.get<uint8_t>() != 0;
+  bool working = r.get<uint8_t>() != 0;
+  int tile = r.get<int>();
+  int pixelInTile = r.get<int>();
+  int pixelsDone = r.get<int>();
+
+  std::istringstream rngStream(r.getString());
+  std::mt19937 mt;
+  rngStream >> mt;
+
+  std::vector<Raytracer::Vec3> color;
+  std::vector<Raytracer::GBufferSample> gbuffer;
+  std::vector<int> samples;
+  r.getArray(color, (long long)width * height);
+  r.getArray(gbuffer, (long long)width * height);
+  r.getArray(samples, (long long)width * height);
+
+  std::vector<Raytracer::RadianceCache::Cell> cacheCells;
+  if ((r.get<uint8_t>() != 0) != Raytracer::radianceCache.enabled) {
+    return -1;
+  }
+  if (Raytracer::radianceCache.enabled && (r.get<double>() != Raytracer::radianceCache.cellSize
+    || r.get<double>() != Raytracer::radianceCache.blend || !r.getArray(cacheCells, Raytracer::radianceCache.cells.size()))) {
+    return -1;
+  }
+  std::vector<Raytracer::PathGuide::Cell> guideCells;
+  if ((r.get<uint8_t>() != 0) != Raytracer::pathGuide.enabled) {
+    return -1;
+  }
+  if (Raytracer::pathGuide.enabled && (r.get<double>() != Raytracer::pathGuide.cellSize
+    || r.get<double>() != Raytracer::pathGuide.fraction || !r.getArray(guideCells, Raytracer::pathGuide.cells.size()))) {
+    return -1;
+  }
+  if (!r.ok || r.pos != r.size || rngStream.fail()) {
+    return -1;
+  }
+  std::vector<Tile> tiles = makeTiles(width, height);
+  if (working && (tile < 0 || tile > (int)tiles.size() || pixelInTile < 0
+    || (pixelInTile > 0 && (tile == (int)tiles.size() || pixelInTile >= tiles[tile].width * tiles[tile].height)))) {
+    return -1;
+  }
+
+  if (width != stream.frame.width || height != stream.frame.height) {
+    MemoryUsage usage = memoryUsage();
+    usage.framebuffers = 0;
+    if (!usage.fits(Framebuffer::bytesOf(width, height) + (size_t)width * height * (4 * sizeof(int) + 3 * sizeof(float)))) {
+      return -1;
+    }
+  }
+
+  // ここから先は失敗しない
+  stream.frame.resize(width, height);
+  stream.frame.color = std::move(color);
+  stream.frame.gbuffer = std::move(gbuffer);
+  stream.frame.samples = std::move(samples);
+  stream.settings.cam = cam;
+  stream.changed = changed;
+  Raytracer::mt = mt;
+  if (Raytracer::radianceCache.enabled) Raytracer::radianceCache.cells = std::move(cacheCells);
+  if (Raytracer::pathGuide.enabled) Raytracer::pathGuide.cells = std::move(guideCells);
+
+  if (working) {
+    // 描画中のパスの tile 番目のタイルの pixelInTile 番目の画素から続ける(パスの始めの処理は作ったときに済んでいる)
+    stream.working = true;
+    stream.settings.width = width;
+    stream.settings.height = height;
+    stream.progress.tiles = std::move(tiles);
+    stream.progress.tile = tile;
+    stream.progress.pixelInTile = pixelInTile;
+    if (pixelInTile > 0) {
+      const Tile& t = stream.progress.tiles[tile];
+      stream.progress.order = mortonOrder(t.width, t.height);
+    }
+    stream.progress.pixelsDone = pixelsDone;
+    stream.progress.tileMs = 0;
+    stream.progress.msPerPixel = 0;
+    stream.progress.previewLevel = 0;
+    stream.progress.previewBlock = 0;
+    stream.progress.msPerBlock = 0;
+    selectIntegrator();
+    if (stream.settings.rasterize) {
+      stream.rasterizer.bin(stream.settings.stage, stream.settings.cam, width, height);
+    }
+    renderStats.reset();
+  }
+  return 0;
+}
+
 #ifdef __cplusplus
 }
-#endif
\ No newline at end of file
+#endif
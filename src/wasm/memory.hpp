@@ -0,0 +1,134 @@
+#ifndef MEMORY_HPP
+#define MEMORY_HPP
+
+#include <vector>
+#include <string>
+#include <memory>
+#include <cstddef>
+#include <new>
+#include <type_traits>
+
+//まとめて確保してまとめて捨てる一時領域
+//BVH構築の作業用配列や、1フレームの仕上げ(平均・デノイズ)の作業用バッファに使う
+//個別の解放はせず、rewindで印まで戻すか、resetで全部を空にする
+class Arena{
+    struct Block{
+        std::unique_ptr<char[]> data;
+        size_t size;
+    };
+    std::vector<Block> blocks;
+    size_t current = 0; //使用中のブロック
+    size_t offset = 0; //そのブロック内の使用量
+    size_t blockSize;
+
+    public:
+    struct Marker{
+        size_t block, offset;
+    };
+
+    explicit Arena(size_t blockSize = 1 << 16) : blockSize(blockSize) {}
+
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    void* allocate(size_t bytes, size_t align = alignof(std::max_align_t)){
+        while(current < blocks.size()){
+            size_t p = (offset + align - 1) / align * align;
+            if(p + bytes <= blocks[current].size){
+                offset = p + bytes;
+                return blocks[current].data.get() + p;
+            }
+            //このブロックには入らないので、次のブロックか新しいブロックへ
+            if(current + 1 < blocks.size() && blocks[current + 1].size >= bytes + align){
+                current++;
+                offset = 0;
+                continue;
+            }
+            break;
+        }
+        size_t size = std::max(blockSize, bytes + align);
+        size_t at = blocks.empty() ? 0 : current + 1;
+        blocks.insert(blocks.begin() + at, Block{std::unique_ptr<char[]>(new char[size]), size});
+        current = at;
+        offset = 0;
+        return allocate(bytes, align);
+    }
+
+    //n個のTを値初期化して確保する(デストラクタは呼ばれないので、自明に破棄できる型のみ)
+    template<typename T>
+    T* make(size_t n){
+        static_assert(std::is_trivially_destructible<T>::value, "Arena cannot destroy T");
+        T* p = static_cast<T*>(allocate(sizeof(T) * std::max<size_t>(n, 1), alignof(T)));
+        for(size_t i = 0; i < n; i++) new (p + i) T();
+        return p;
+    }
+
+    Marker mark() const {
+        return {current, offset};
+    }
+
+    //markより後に確保したものをまとめて捨てる(ブロックは再利用のため残す)
+    void rewind(Marker m){
+        current = m.block;
+        offset = m.offset;
+    }
+
+    //全部捨てる。ブロックが複数あれば次から1つで足りるように作り直す
+    void reset(){
+        if(blocks.size() > 1){
+            size_t total = capacity();
+            blocks.clear();
+            blocks.push_back(Block{std::unique_ptr<char[]>(new char[total]), total});
+        }
+        current = 0;
+        offset = 0;
+    }
+
+    //確保しているブロックを全て解放する
+    void release(){
+        std::vector<Block>().swap(blocks);
+        current = 0;
+        offset = 0;
+    }
+
+    size_t capacity() const {
+        size_t sum = 0;
+        for(const Block& b : blocks) sum += b.size;
+        return sum;
+    }
+};
+
+//サブシステムごとのメモリ使用量(バイト)
+struct MemoryUsage{
+    size_t geometry = 0; //頂点と三角形
+    size_t bvhNodes = 0;
+    size_t textures = 0;
+    size_t framebuffers = 0; //累積バッファとJSから渡される画素の配列
+    size_t scratch = 0; //フレームごとの作業用領域
+    size_t caches = 0; //フレームをまたいで学習するワールド空間のキャッシュ
+    size_t heap = 0; //wasmのヒープ全体(ネイティブでは0)
+    size_t budget = 0; //0なら上限なし
+
+    size_t total() const {
+        return geometry + bvhNodes + textures + framebuffers + scratch + caches;
+    }
+
+    //extraバイト増えても上限に収まるか
+    bool fits(size_t extra) const {
+        return budget == 0 || total() + extra <= budget;
+    }
+
+    std::string toJSON() const {
+        return "{\"geometry\":" + std::to_string(geometry)
+            + ",\"bvhNodes\":" + std::to_string(bvhNodes)
+            + ",\"textures\":" + std::to_string(textures)
+            + ",\"framebuffers\":" + std::to_string(framebuffers)
+            + ",\"scratch\":" + std::to_string(scratch)
+            + ",\"caches\":" + std::to_string(caches)
+            + ",\"total\":" + std::to_string(total())
+            + ",\"heap\":" + std::to_string(heap)
+            + ",\"budget\":" + std::to_string(budget) + "}";
+    }
+};
+
+#endif
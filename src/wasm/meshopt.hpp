@@ -0,0 +1,95 @@
+#ifndef MESHOPT_HPP
+#define MESHOPT_HPP
+
+#include <vector>
+#include <array>
+#include <unordered_map>
+#include <functional>
+#include <cstdint>
+#include <cstring>
+#include "simpleIntersect.hpp"
+
+struct vert{
+    point3 point;
+    vec3 norm;
+    texpoint texcoord;
+};
+
+//座標・法線・テクスチャ座標がすべてビット単位で一致する頂点をまとめる
+//glTFなどでは面ごとに頂点が複製されていることが多いので、BVHを作る前に減らしておく
+//== で比べると +0.0 と -0.0 がまとまり NaN はまとまらないので、ビット列で比べる
+void weldVertices(std::vector<vert>& vertex,std::vector<std::array<int,3>>& polygon){
+    auto key = [](const vert& v){
+        const double values[8] = {
+            v.point.x,v.point.y,v.point.z,
+            v.norm.x,v.norm.y,v.norm.z,
+            v.texcoord.x,v.texcoord.y
+        };
+        std::array<uint64_t,8> bits;
+        std::memcpy(bits.data(),values,sizeof(values));
+        return bits;
+    };
+    struct keyHash{
+        size_t operator()(const std::array<uint64_t,8>& k) const {
+            size_t h = 0;
+            for(uint64_t x : k){
+                h ^= std::hash<uint64_t>()(x) + 0x9e3779b97f4a7c15ULL + (h<<6) + (h>>2);
+            }
+            return h;
+        }
+    };
+
+    std::unordered_map<std::array<uint64_t,8>,int,keyHash> unique;
+    unique.reserve(vertex.size());
+    std::vector<int> remap(vertex.size());
+    int n = 0;
+    for(int i=0;i<(int)vertex.size();i++){
+        auto it = unique.emplace(key(vertex[i]),n);
+        if(it.second){
+            vertex[n] = vertex[i];
+            n++;
+        }
+        remap[i] = it.first->second;
+    }
+    vertex.resize(n);
+    vertex.shrink_to_fit();
+
+    for(auto& p : polygon){
+        for(int j=0;j<3;j++)p[j] = remap[p[j]];
+    }
+}
+
+//法線がないメッシュのために、面積で重みをつけた面法線の平均を頂点法線にする
+void computeNormals(std::vector<vert>& vertex,const std::vector<std::array<int,3>>& polygon){
+    for(auto& v : vertex)v.norm = {0,0,0};
+    for(const auto& p : polygon){
+        const point3 &a = vertex[p[0]].point,&b = vertex[p[1]].point,&c = vertex[p[2]].point;
+        vec3 n = crossProduct({b.x-a.x,b.y-a.y,b.z-a.z},{c.x-a.x,c.y-a.y,c.z-a.z});
+        for(int j=0;j<3;j++){
+            vertex[p[j]].norm.x += n.x;
+            vertex[p[j]].norm.y += n.y;
+            vertex[p[j]].norm.z += n.z;
+        }
+    }
+    for(auto& v : vertex)v.norm = normalize(v.norm);
+}
+
+//polygonの順に初めて使われた順へ頂点を並べ替え、polygonの添字を付け替える
+//polygonをBVHの葉の順にしておけば、葉の近くの頂点がメモリ上でも近くなる
+void reorderVertices(std::vector<vert>& vertex,std::vector<std::array<int,3>>& polygon){
+    std::vector<int> remap(vertex.size(),-1);
+    std::vector<vert> ordered;
+    ordered.reserve(vertex.size());
+    for(auto& p : polygon){
+        for(int j=0;j<3;j++){
+            if(remap[p[j]] < 0){
+                remap[p[j]] = ordered.size();
+                ordered.push_back(vertex[p[j]]);
+            }
+            p[j] = remap[p[j]];
+        }
+    }
+    vertex = std::move(ordered);
+}
+
+#endif
@@ -0,0 +1,150 @@
+#ifndef RASTERIZER_HPP
+#define RASTERIZER_HPP
+
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include "tile.hpp"
+
+//可視性バッファの1サンプル
+//カメラレイの向きと、そのレイの最初の交差(モデル番号、三角形番号、重心座標、距離)
+struct VisibilitySample{
+    Raytracer::Vec3 dir;
+    stageHit hit;
+};
+
+//ピンホールカメラから見える最初の交差を、レイを飛ばさずに三角形をタイルに振り分けて求める
+//頂点はカメラの位置からの相対座標で持ち、辺とカメラの位置が作る平面でサンプルの向きを判定する
+//(同次座標でのラスタライズなので、カメラの後ろにかかる三角形も切り取らずに扱える)
+class Rasterizer{
+    struct Triangle{
+        Raytracer::Vec3 a,b,c; //カメラからの相対座標
+        int model,prim;
+        int x0,y0,x1,y1; //覆うかもしれない画素の範囲
+    };
+    std::vector<Triangle> triangles;
+    std::vector<std::vector<int>> bins; //タイルごとの三角形の番号
+    int tilesX = 0;
+    int tileSize = TILE_SIZE;
+
+    public:
+    //ステージの全ての三角形を画面に投影し、重なるタイルに振り分ける
+    //タイルの並びはmakeTiles(width,height,size)と同じ
+    void bin(Stage& stage,const camera& cam,int width,int height,int size = TILE_SIZE){
+        tileSize = size;
+        tilesX = (width + size - 1) / size;
+        int tilesY = (height + size - 1) / size;
+        triangles.clear();
+        bins.resize(tilesX * tilesY);
+        for(auto& b : bins)b.clear();
+
+        //カメラレイの向きは camRight * u + camUp * v + forward * dist なので、その逆行列で (u, v) に戻す
+        using Raytracer::Vec3;
+        Vec3 r = cam.camRight, u = cam.camUp, f = cam.forward * cam.dist;
+        Vec3 row0 = Raytracer::cross(u,f), row1 = Raytracer::cross(f,r), row2 = Raytracer::cross(r,u);
+        double det = Raytracer::dot(r,row0);
+        if(det == 0)return;
+        row0 = row0 / det;
+        row1 = row1 / det;
+        row2 = row2 / det;
+
+        stage.forEachTriangle([&](int model,int prim,const point3& p0,const point3& p1,const point3& p2){
+            Triangle tri;
+            tri.a = Vec3(p0.x,p0.y,p0.z) - cam.pos;
+            tri.b = Vec3(p1.x,p1.y,p1.z) - cam.pos;
+            tri.c = Vec3(p2.x,p2.y,p2.z) - cam.pos;
+            tri.model = model;
+            tri.prim = prim;
+
+            const Vec3* v[3] = {&tri.a,&tri.b,&tri.c};
+            double z[3];
+            int behind = 0;
+            for(int k=0;k<3;k++){
+                z[k] = Raytracer::dot(*v[k],row2);
+                if(z[k] <= 1e-9)behind++;
+            }
+            if(behind == 3)return;
+
+            if(behind > 0){
+                //カメラの面をまたぐ三角形は画面全体にかかるものとして扱う
+                tri.x0 = 0;
+                tri.y0 = 0;
+                tri.x1 = width - 1;
+                tri.y1 = height - 1;
+            }else{
+                double xm = INFF,xM = -INFF,ym = INFF,yM = -INFF;
+                for(int k=0;k<3;k++){
+                    double x = Raytracer::dot(*v[k],row0) / z[k] * height + width / 2;
+                    double y = -Raytracer::dot(*v[k],row1) / z[k] * height + height / 2;
+                    xm = std::min(xm,x);
+                    xM = std::max(xM,x);
+                    ym = std::min(ym,y);
+                    yM = std::max(yM,y);
+                }
+                //丸め誤差で辺の上のサンプルを落とさないよう1画素広げる
+                if(xM < -1 || yM < -1 || xm > width + 1 || ym > height + 1)return;
+                tri.x0 = std::max(0,(int)std::floor(xm) - 1);
+                tri.y0 = std::max(0,(int)std::floor(ym) - 1);
+                tri.x1 = std::min(width - 1,(int)std::floor(xM) + 1);
+                tri.y1 = std::min(height - 1,(int)std::floor(yM) + 1);
+            }
+
+            int index = triangles.size();
+            triangles.push_back(tri);
+            for(int ty=tri.y0/size;ty<=tri.y1/size;ty++){
+                for(int tx=tri.x0/size;tx<=tri.x1/size;tx++){
+                    bins[ty * tilesX + tx].push_back(index);
+                }
+            }
+        });
+    }
+
+    //tileIndex番目のタイルの可視性バッファを埋める
+    //samplesはタイル内の画素(行優先)ごとにspp個並び、dirを設定してhitを外れにしておくこと
+    //intersectStageClosestと同じく(tMin, ∞)で最も近い交差を残す
+    void rasterize(int tileIndex,const Tile& tile,int spp,double tMin,VisibilitySample* samples) const {
+        using Raytracer::Vec3;
+        for(int index : bins[tileIndex]){
+            const Triangle& tri = triangles[index];
+            //辺とカメラの位置を通る平面の法線(サンプルの向きとの内積が重心座標に比例する)
+            Vec3 eBC = Raytracer::cross(tri.b,tri.c);
+            Vec3 eCA = Raytracer::cross(tri.c,tri.a);
+            Vec3 eAB = Raytracer::cross(tri.a,tri.b);
+            Vec3 normal = Raytracer::cross(tri.b - tri.a,tri.c - tri.a);
+            double plane = Raytracer::dot(normal,tri.a);
+
+            int x0 = std::max(tri.x0,tile.x),x1 = std::min(tri.x1,tile.x + tile.width - 1);
+            int y0 = std::max(tri.y0,tile.y),y1 = std::min(tri.y1,tile.y + tile.height - 1);
+            for(int y=y0;y<=y1;y++){
+                for(int x=x0;x<=x1;x++){
+                    VisibilitySample* s = samples + ((y - tile.y) * tile.width + (x - tile.x)) * spp;
+                    for(int k=0;k<spp;k++){
+                        const Vec3& d = s[k].dir;
+                        double w0 = Raytracer::dot(d,eBC),w1 = Raytracer::dot(d,eCA),w2 = Raytracer::dot(d,eAB);
+                        if((w0 < 0 || w1 < 0 || w2 < 0) && (w0 > 0 || w1 > 0 || w2 > 0))continue;
+                        double det = w0 + w1 + w2;
+                        double nd = Raytracer::dot(normal,d);
+                        if(det == 0 || nd == 0)continue;
+
+                        double t = plane / nd;
+                        if(!(t > tMin && t < s[k].hit.t))continue;
+                        s[k].hit = {true,t,w1 / det,w2 / det,tri.prim,tri.model};
+                    }
+                }
+            }
+        }
+    }
+
+    size_t bytes() const {
+        size_t sum = triangles.capacity() * sizeof(Triangle);
+        for(const auto& b : bins)sum += b.capacity() * sizeof(int);
+        return sum;
+    }
+
+    void release(){
+        std::vector<Triangle>().swap(triangles);
+        std::vector<std::vector<int>>().swap(bins);
+    }
+};
+
+#endif
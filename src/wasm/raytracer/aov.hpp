@@ -0,0 +1,73 @@
+#ifndef RAYTRACER_AOV_HPP
+#define RAYTRACER_AOV_HPP
+
+#include <vector>
+#include "vec3.hpp"
+#include "gbuffer.hpp"
+
+namespace Raytracer {
+  // JS側 (src/core/renderer/AOV.ts) と番号を合わせること
+  enum AOVType {
+    AOV_DEPTH = 0,
+    AOV_NORMAL = 1,
+    AOV_ALBEDO = 2,
+    AOV_MATERIAL_ID = 3,
+    AOV_OBJECT_ID = 4,
+    AOV_UV = 5,
+    AOV_HIT_COUNT = 6,
+    AOV_TRAVERSAL_COST = 7,
+    AOV_COUNT = 8,
+  };
+
+  int aovChannels(int type) {
+    switch (type) {
+      case AOV_DEPTH: return 1;
+      case AOV_NORMAL: return 3;
+      case AOV_ALBEDO: return 3;
+      case AOV_MATERIAL_ID: return 1;
+      case AOV_OBJECT_ID: return 1;
+      case AOV_UV: return 2;
+      case AOV_HIT_COUNT: return 1;
+      case AOV_TRAVERSAL_COST: return 1;
+      default: return -1;
+    }
+  }
+
+  // 1画素分の G-buffer から1種類のAOVを取り出して p (channels 個) に書き出し、チャンネル数を返す
+  int writeAOV(const GBufferSample& g, int type, float* p) {
+    const int channels = aovChannels(type);
+    if (channels < 0) return -1;
+
+    switch (type) {
+      case AOV_DEPTH:
+        p[0] = g.depth;
+        break;
+      case AOV_NORMAL: {
+        Vec3 n = g.normal.length2() > 0 ? normalize(g.normal) : Vec3(0);
+        p[0] = n.x; p[1] = n.y; p[2] = n.z;
+        break;
+      }
+      case AOV_ALBEDO:
+        p[0] = g.albedo.x; p[1] = g.albedo.y; p[2] = g.albedo.z;
+        break;
+      case AOV_MATERIAL_ID:
+        p[0] = g.materialId;
+        break;
+      case AOV_OBJECT_ID:
+        p[0] = g.objectId;
+        break;
+      case AOV_UV:
+        p[0] = g.uv.x; p[1] = g.uv.y;
+        break;
+      case AOV_HIT_COUNT:
+        p[0] = g.hitCount;
+        break;
+      case AOV_TRAVERSAL_COST:
+        p[0] = g.traversalCost;
+        break;
+    }
+    return channels;
+  }
+}
+
+#endif
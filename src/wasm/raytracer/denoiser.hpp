@@ -0,0 +1,102 @@
+#ifndef RAYTRACER_DENOISER_HPP
+#define RAYTRACER_DENOISER_HPP
+
+#include <vector>
+#include <cmath>
+#include "vec3.hpp"
+#include "gbuffer.hpp"
+#include "../memory.hpp"
+
+namespace Raytracer {
+  // Edge-avoiding à-trous wavelet filter (Dammertz et al. 2010)
+  // albedo で割った照度をぼかしてから albedo を掛け戻すので、テクスチャはぼけない
+  class Denoiser {
+    public:
+      int iterations = 5;
+      double sigmaColor = 0.4;
+      double sigmaNormal = 64.0;
+      double sigmaDepth = 0.3;
+      double sigmaAlbedo = 0.1;
+
+      // color, gbuffer は画素ごとの平均 (width * height, 行優先)
+      // 作業用バッファは scratch から取る(呼び出し側がフレームの終わりにまとめて捨てる)
+      void apply(
+        const Vec3* color,
+        const GBufferSample* gbuffer,
+        int width,
+        int height,
+        Vec3* out,
+        Arena& scratch
+      ) {
+        const int size = width * height;
+        const double kernel[5] = {1.0/16, 1.0/4, 3.0/8, 1.0/4, 1.0/16};
+
+        Vec3* irradiance = scratch.make<Vec3>(size);
+        Vec3* next = scratch.make<Vec3>(size);
+        Vec3* normals = scratch.make<Vec3>(size);
+
+        // demodulate
+        for(int p = 0; p < size; p++){
+          irradiance[p] = color[p] / safeAlbedo(gbuffer[p].albedo);
+          const Vec3& n = gbuffer[p].normal;
+          normals[p] = n.length2() > 0 ? normalize(n) : Vec3(0);
+        }
+
+        double sigmaC = sigmaColor;
+        for(int it = 0; it < iterations; it++){
+          const int step = 1 << it;
+          for(int j = 0; j < height; j++){
+            for(int i = 0; i < width; i++){
+              const int p = j * width + i;
+              const Vec3& cp = irradiance[p];
+              const Vec3& np = normals[p];
+              const GBufferSample& gp = gbuffer[p];
+
+              Vec3 sum(0);
+              double weightSum = 0;
+              for(int dy = -2; dy <= 2; dy++){
+                const int y = j + dy * step;
+                if(y < 0 || y >= height) continue;
+                for(int dx = -2; dx <= 2; dx++){
+                  const int x = i + dx * step;
+                  if(x < 0 || x >= width) continue;
+
+                  const int q = y * width + x;
+                  const Vec3& cq = irradiance[q];
+                  const Vec3& nq = normals[q];
+                  const GBufferSample& gq = gbuffer[q];
+
+                  double w = kernel[dx + 2] * kernel[dy + 2];
+                  w *= std::exp(-(cp - cq).length2() / (sigmaC * sigmaC));
+                  if(np.length2() > 0 || nq.length2() > 0){
+                    w *= std::pow(std::max(0.0, dot(np, nq)), sigmaNormal);
+                  }
+                  w *= std::exp(-std::abs(gp.depth - gq.depth) / (sigmaDepth * step));
+                  w *= std::exp(-(gp.albedo - gq.albedo).length2() / (sigmaAlbedo * sigmaAlbedo));
+
+                  sum += cq * w;
+                  weightSum += w;
+                }
+              }
+              next[p] = weightSum > 0 ? sum / weightSum : cp;
+            }
+          }
+          std::swap(irradiance, next);
+          sigmaC *= 0.5;
+        }
+
+        // remodulate
+        for(int p = 0; p < size; p++){
+          out[p] = irradiance[p] * safeAlbedo(gbuffer[p].albedo);
+        }
+      }
+
+    private:
+      static Vec3 safeAlbedo(const Vec3& albedo) {
+        const double eps = 1e-3;
+        return Vec3(std::max(albedo.x, eps), std::max(albedo.y, eps), std::max(albedo.z, eps));
+      }
+  };
+}
+
+#endif
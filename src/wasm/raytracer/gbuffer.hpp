@@ -0,0 +1,43 @@
+#ifndef RAYTRACER_GBUFFER_HPP
+#define RAYTRACER_GBUFFER_HPP
+
+#include "vec3.hpp"
+
+namespace Raytracer {
+  // 最初の衝突点の情報(デノイザのガイドやAOV出力に使う)
+  struct GBufferSample {
+    Vec3 albedo;
+    Vec3 normal;
+    double depth = 0;
+    Vec3 uv;
+    int materialId = -1;
+    int objectId = -1;
+    double hitCount = 0; // パス中で表面に当たった回数
+    double traversalCost = 0; // BVHのノード訪問+三角形判定の回数 (RAYTRACER_STATS 有効時のみ)
+
+    // IDは平均できないので最初に書き込まれたサンプルの値を残す
+    GBufferSample& operator+=(const GBufferSample& g) {
+      albedo += g.albedo;
+      normal += g.normal;
+      depth += g.depth;
+      uv += g.uv;
+      if (materialId < 0) materialId = g.materialId;
+      if (objectId < 0) objectId = g.objectId;
+      hitCount += g.hitCount;
+      traversalCost += g.traversalCost;
+      return *this;
+    };
+
+    GBufferSample& operator*=(double k) {
+      albedo *= Vec3(k);
+      normal *= Vec3(k);
+      depth *= k;
+      uv *= Vec3(k);
+      hitCount *= k;
+      traversalCost *= k;
+      return *this;
+    };
+  };
+}
+
+#endif
@@ -7,7 +7,16 @@
 namespace Raytracer::Material {
   struct BaseMaterial {
     bool isNEE = true;
+    int id = -1;
     virtual Raytracer::Vec3 sample(const Raytracer::Vec3& wo, Raytracer::Vec3& wi, double &pdf, Raytracer::Vec3& uv, Raytracer::Texture &textures) = 0;
+    // デノイザ用の反射率(テクスチャ込み)
+    virtual Raytracer::Vec3 albedo(Raytracer::Vec3& uv, Raytracer::Texture &textures) = 0;
+    // 方向 wi の BSDF と、sample がその wi を選ぶ確率密度 pdf (パスガイディングの MIS 用)
+    // 求められない材質(鏡面など)は pdf = 0 を返し、ガイドされない
+    virtual Raytracer::Vec3 evaluate(const Raytracer::Vec3& wo, const Raytracer::Vec3& wi, double &pdf, Raytracer::Vec3& uv, Raytracer::Texture &textures) {
+      pdf = 0;
+      return Raytracer::Vec3(0);
+    }
   };
 }
 
@@ -16,6 +16,30 @@ namespace Raytracer::Material {
       Diffuse(const Raytracer::Vec3& _rho, int _texId) : rho(_rho), texId(_texId) {};
 
       Raytracer::Vec3 sample(const Raytracer::Vec3& wo, Raytracer::Vec3& wi, double &pdf, Raytracer::Vec3& uv, Raytracer::Texture &textures) override {
+        return sampleWith<true>(wo, wi, pdf, uv, textures);
+      };
+
+      Raytracer::Vec3 albedo(Raytracer::Vec3& uv, Raytracer::Texture &textures) override {
+        return reflectance<true>(uv, textures);
+      };
+
+      Raytracer::Vec3 evaluate(const Raytracer::Vec3& wo, const Raytracer::Vec3& wi, double &pdf, Raytracer::Vec3& uv, Raytracer::Texture &textures) override {
+        return evaluateWith<true>(wo, wi, pdf, uv, textures);
+      };
+
+      // 以下は拡散面しかないシーンで積分器から仮想関数を通さずに呼ぶ
+      // Textured = false ならテクスチャを引かない(シーンにテクスチャを使うマテリアルがないとき)
+      template <bool Textured>
+      Raytracer::Vec3 reflectance(Raytracer::Vec3& uv, Raytracer::Texture &textures) const {
+        if constexpr (Textured) {
+          return rho * textures.get(texId, uv);
+        } else {
+          return rho;
+        }
+      }
+
+      template <bool Textured>
+      Raytracer::Vec3 sampleWith(const Raytracer::Vec3& wo, Raytracer::Vec3& wi, double &pdf, Raytracer::Vec3& uv, Raytracer::Texture &textures) const {
         double u = rnd();
         double v = rnd();
 
@@ -30,8 +54,19 @@ namespace Raytracer::Material {
 
         pdf = std::cos(theta)/M_PI;
 
-        return rho * textures.get(texId, uv) / M_PI;
-      };
+        return reflectance<Textured>(uv, textures) / M_PI;
+      }
+
+      // sample は法線側の半球だけを cos に比例して選ぶ
+      template <bool Textured>
+      Raytracer::Vec3 evaluateWith(const Raytracer::Vec3& wo, const Raytracer::Vec3& wi, double &pdf, Raytracer::Vec3& uv, Raytracer::Texture &textures) const {
+        if (wi.y <= 0) {
+          pdf = 0;
+          return Raytracer::Vec3(0);
+        }
+        pdf = wi.y / M_PI;
+        return reflectance<Textured>(uv, textures) / M_PI;
+      }
   };
 }
 
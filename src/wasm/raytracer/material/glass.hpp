@@ -70,6 +70,10 @@ namespace Raytracer::Material {
           }
         }
       };
+
+      Raytracer::Vec3 albedo(Raytracer::Vec3& uv, Texture &textures) override {
+        return Raytracer::Vec3(1.0);
+      };
   };
 }
 
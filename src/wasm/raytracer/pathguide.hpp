@@ -0,0 +1,139 @@
+#ifndef RAYTRACER_PATHGUIDE_HPP
+#define RAYTRACER_PATHGUIDE_HPP
+
+#include <vector>
+#include <cstdint>
+#include <cmath>
+#include <algorithm>
+#include "vec3.hpp"
+#include "random.hpp"
+#include "radiancecache.hpp"
+
+//ハッシュ表の大きさ(2の冪)
+#define PATH_GUIDE_BITS 13
+#define PATH_GUIDE_PROBES 16
+//方向のヒストグラムの分割数(cosθ と φ で等面積に分ける)
+#define PATH_GUIDE_THETA 8
+#define PATH_GUIDE_PHI 8
+#define PATH_GUIDE_BINS (PATH_GUIDE_THETA * PATH_GUIDE_PHI)
+//このサンプル数を学習したセルだけを次のパスからサンプリングに使う
+#define PATH_GUIDE_MIN_SAMPLES 32
+//学習したヒストグラムに混ぜる一様分布の割合(どの方向も選ばれうるようにする)
+#define PATH_GUIDE_UNIFORM 0.1
+
+namespace Raytracer {
+  // パスガイディング: 拡散面の頂点から先で得た放射輝度を、場所(格子)ごとに方向のヒストグラムで覚え、
+  // 次のパスからはそれに比例して反射方向を選ぶ
+  // BSDF のサンプリングとは確率 fraction で選び分け、両方の pdf の和で割る(1サンプルの MIS、バランスヒューリスティック)
+  struct PathGuide {
+    struct Cell {
+      uint64_t key = 0; // 0 なら空き
+      uint32_t samples = 0; // 学習したサンプル数
+      bool ready = false; // cdf が使えるか
+      float train[PATH_GUIDE_BINS] = {}; // 学習中の放射輝度 / pdf の和
+      float cdf[PATH_GUIDE_BINS] = {}; // 直前のパスまでで作ったサンプリング用の累積分布
+    };
+
+    bool enabled = false;
+    double cellSize = 0.25;
+    double fraction = 0.5; // ガイドから方向を選ぶ確率
+    std::vector<Cell> cells;
+
+    void configure(bool _enabled, double _cellSize, double _fraction) {
+      enabled = _enabled;
+      cellSize = _cellSize;
+      fraction = _fraction;
+      if (enabled) {
+        cells.assign(1 << PATH_GUIDE_BITS, Cell());
+      } else {
+        std::vector<Cell>().swap(cells);
+      }
+    }
+
+    void clear() {
+      std::fill(cells.begin(), cells.end(), Cell());
+    }
+
+    size_t bytes() const {
+      return cells.capacity() * sizeof(Cell);
+    }
+
+    // 点 p (法線 n は入射側を向いていること) のセルの番号。insert なら無ければ作る
+    int find(const Vec3& p, const Vec3& n, bool insert) {
+      uint64_t key = worldCellKey(p, n, cellSize);
+      uint64_t h = worldCellSlot(key, PATH_GUIDE_BITS);
+      const uint64_t mask = cells.size() - 1;
+      for (int k = 0; k < PATH_GUIDE_PROBES; k++) {
+        size_t index = (h + k) & mask;
+        if (cells[index].key == key) return index;
+        if (cells[index].key == 0) {
+          if (!insert) return -1;
+          cells[index].key = key;
+          return index;
+        }
+      }
+      return -1;
+    }
+
+    // パスの区切りで、学習したヒストグラムからサンプリング用の分布を作り直す
+    // 学習の和は捨てずに足し続けるので、パスを重ねるほど分布が滑らかになる
+    void refresh() {
+      for (Cell& c : cells) {
+        if (c.key == 0 || c.samples < PATH_GUIDE_MIN_SAMPLES) continue;
+        double sum = 0;
+        for (int b = 0; b < PATH_GUIDE_BINS; b++) sum += c.train[b];
+        if (!(sum > 0)) continue;
+        double acc = 0;
+        for (int b = 0; b < PATH_GUIDE_BINS; b++) {
+          acc += (1 - PATH_GUIDE_UNIFORM) * c.train[b] / sum + PATH_GUIDE_UNIFORM / PATH_GUIDE_BINS;
+          c.cdf[b] = (float)acc;
+        }
+        c.cdf[PATH_GUIDE_BINS - 1] = 1;
+        c.ready = true;
+      }
+    }
+
+    bool ready(int index) const {
+      return index >= 0 && cells[index].ready;
+    }
+
+    static int binOf(const Vec3& d) {
+      int it = std::min(PATH_GUIDE_THETA - 1, std::max(0, (int)((d.y + 1) * 0.5 * PATH_GUIDE_THETA)));
+      double phi = std::atan2(d.z, d.x);
+      int ip = std::min(PATH_GUIDE_PHI - 1, std::max(0, (int)((phi + M_PI) / (2 * M_PI) * PATH_GUIDE_PHI)));
+      return it * PATH_GUIDE_PHI + ip;
+    }
+
+    // ワールド座標の方向 d を選ぶ確率密度(立体角あたり)
+    double pdf(int index, const Vec3& d) const {
+      const Cell& c = cells[index];
+      int b = binOf(d);
+      double p = c.cdf[b] - (b > 0 ? c.cdf[b - 1] : 0.0f);
+      return p * PATH_GUIDE_BINS / (4 * M_PI);
+    }
+
+    // 分布に従ってワールド座標の方向を選ぶ
+    Vec3 sample(int index) const {
+      const Cell& c = cells[index];
+      float u = (float)rnd();
+      int b = std::lower_bound(c.cdf, c.cdf + PATH_GUIDE_BINS, u) - c.cdf;
+      b = std::min(b, PATH_GUIDE_BINS - 1);
+      int it = b / PATH_GUIDE_PHI, ip = b % PATH_GUIDE_PHI;
+      double y = -1 + 2 * (it + rnd()) / PATH_GUIDE_THETA;
+      double phi = -M_PI + 2 * M_PI * (ip + rnd()) / PATH_GUIDE_PHI;
+      double r = std::sqrt(std::max(0.0, 1 - y * y));
+      return Vec3(r * std::cos(phi), y, r * std::sin(phi));
+    }
+
+    // 方向 d に進んで得た放射輝度の明るさ L を、その方向を選んだ確率密度 p で割って学習する
+    void add(int index, const Vec3& d, double L, double p) {
+      Cell& c = cells[index];
+      c.samples++;
+      if (p > 0 && L > 0) c.train[binOf(d)] += (float)(L / p);
+    }
+  };
+
+  PathGuide pathGuide;
+}
+
+#endif
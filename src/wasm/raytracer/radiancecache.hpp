@@ -0,0 +1,106 @@
+#ifndef RAYTRACER_RADIANCECACHE_HPP
+#define RAYTRACER_RADIANCECACHE_HPP
+
+#include <vector>
+#include <cstdint>
+#include <cmath>
+#include "vec3.hpp"
+
+//ハッシュ表の大きさ(2の冪)
+#define RADIANCE_CACHE_BITS 18
+//衝突したときに隣を探す回数
+#define RADIANCE_CACHE_PROBES 16
+//このサンプル数に達したセルだけを経路の打ち切りに使う
+#define RADIANCE_CACHE_MIN_SAMPLES 8
+
+namespace Raytracer {
+  // 点 p を含む格子のセルと、法線 n の向き(6方向)から作るキー(0 にはならない)
+  inline uint64_t worldCellKey(const Vec3& p, const Vec3& n, double cellSize) {
+    auto axis = [&](double x) {
+      return (uint64_t)((int64_t)std::floor(x / cellSize) & 0xFFFFF);
+    };
+    double ax = std::abs(n.x), ay = std::abs(n.y), az = std::abs(n.z);
+    uint64_t face = ax >= ay && ax >= az ? (n.x < 0 ? 1 : 0) : (ay >= az ? (n.y < 0 ? 3 : 2) : (n.z < 0 ? 5 : 4));
+    return (axis(p.x) | (axis(p.y) << 20) | (axis(p.z) << 40) | (face << 60)) + 1;
+  }
+
+  // key を 2^bits 個の表に入れるときに最初に調べる位置
+  // 掛け算の下位ビットはキーの下位ビットでしか決まらないので、上位ビットを使う
+  inline uint64_t worldCellSlot(uint64_t key, int bits) {
+    return (key * 0x9E3779B97F4A7C15ULL) >> (64 - bits);
+  }
+
+  // 拡散面から出ていく放射輝度をワールド空間の格子で覚えておくキャッシュ
+  // 格子の座標と法線の向き(6方向)をキーにしたハッシュ表で、経路が終わるたびにその頂点の値で更新する
+  // minDepth 段目以降の拡散面で学習済みのセルに当たった経路は、その値を足して打ち切る
+  struct RadianceCache {
+    struct Cell {
+      uint64_t key = 0; // 0 なら空き
+      float r = 0, g = 0, b = 0;
+      uint32_t count = 0;
+    };
+
+    bool enabled = false;
+    double cellSize = 0.25;
+    double blend = 0.05; // 1 / count がこれを下回ったら指数移動平均にする
+    int minDepth = 1;
+    std::vector<Cell> cells;
+
+    void configure(bool _enabled, double _cellSize, double _blend) {
+      enabled = _enabled;
+      cellSize = _cellSize;
+      blend = _blend;
+      if (enabled) {
+        cells.assign(1 << RADIANCE_CACHE_BITS, Cell());
+      } else {
+        std::vector<Cell>().swap(cells);
+      }
+    }
+
+    void clear() {
+      std::fill(cells.begin(), cells.end(), Cell());
+    }
+
+    size_t bytes() const {
+      return cells.capacity() * sizeof(Cell);
+    }
+
+    // 点 p (法線 n は入射側を向いていること) を含むセルの番号。insert なら無ければ作る
+    // 見つからず作れもしなければ -1
+    int find(const Vec3& p, const Vec3& n, bool insert) {
+      uint64_t key = worldCellKey(p, n, cellSize);
+      uint64_t h = worldCellSlot(key, RADIANCE_CACHE_BITS);
+      const uint64_t mask = cells.size() - 1;
+      for (int k = 0; k < RADIANCE_CACHE_PROBES; k++) {
+        size_t index = (h + k) & mask;
+        if (cells[index].key == key) return index;
+        if (cells[index].key == 0) {
+          if (!insert) return -1;
+          cells[index].key = key;
+          return index;
+        }
+      }
+      return -1;
+    }
+
+    // 十分に学習したセルなら値を L に入れて true を返す
+    bool lookup(int index, Vec3& L) const {
+      if (index < 0 || cells[index].count < RADIANCE_CACHE_MIN_SAMPLES) return false;
+      L = Vec3(cells[index].r, cells[index].g, cells[index].b);
+      return true;
+    }
+
+    void add(int index, const Vec3& L) {
+      Cell& c = cells[index];
+      c.count++;
+      float a = (float)std::max(blend, 1.0 / c.count);
+      c.r += ((float)L.x - c.r) * a;
+      c.g += ((float)L.y - c.g) * a;
+      c.b += ((float)L.z - c.b) * a;
+    }
+  };
+
+  RadianceCache radianceCache;
+}
+
+#endif
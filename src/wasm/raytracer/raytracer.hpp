@@ -4,139 +4,414 @@
 #include "../BVH.hpp"
 #include "material.hpp"
 #include "light.hpp"
+#include "gbuffer.hpp"
+#include "radiancecache.hpp"
+#include "pathguide.hpp"
+#include "../memory.hpp"
+#include <algorithm>
+#include <cstdint>
+#include <utility>
+#include <vector>
 #include <stdio.h>
 
 #define MAX_REFLECT 10
 #define ROULETTE 0.99
 
-// #define RAYTRACER_DEBUG
-
-
 namespace Raytracer {
-  #ifdef RAYTRACER_DEBUG
-  
-  Color raytrace(Ray& init_ray, Stage& stage, Texture& textures) {
+  // 積分器を特殊化する機能(テンプレート引数のビット)
+  // pathTracer でシーンと設定を調べて、使わない機能の分岐を取り除いた版を選ぶ
+  enum IntegratorFeature {
+    INTEGRATOR_NEE = 1, // NEE をするマテリアルがある
+    INTEGRATOR_TEXTURES = 2, // テクスチャを使う拡散面がある
+    INTEGRATOR_GLASS = 4, // 拡散面以外(ガラスなど)のマテリアルがある。なければ仮想関数を通さずに Diffuse を呼ぶ
+    INTEGRATOR_AOV = 8, // 最初の交差を G-buffer に書く
+    INTEGRATOR_LEARNING = 16, // 放射輝度キャッシュかパスガイディングを使う
+    INTEGRATOR_ALL = 31
+  };
 
-    Ray ray = init_ray;
-    ray.pos = init_ray.pos;
-    ray.dir = init_ray.dir;
+  // 追跡中の経路1本の状態
+  // raytrace は1本ずつ、traceBatch はまとめて1段ずつ進める
+  struct PathState {
+    Ray ray{Vec3(), Vec3()};
+    Vec3 throughput{1.0};
+    Vec3 radiance{0.0};
+    GBufferSample gbuffer{};
+    int depth = 0;
+    bool alive = true;
+    // 放射輝度キャッシュに書き戻す拡散面の頂点(セル、到達したときの throughput と radiance)
+    int cacheVertices = 0;
+    int cacheCell[MAX_REFLECT];
+    Vec3 cacheThroughput[MAX_REFLECT];
+    Vec3 cacheRadiance[MAX_REFLECT];
+    // パスガイディングの学習に使う頂点(セル、選んだ方向とその pdf、反射後の throughput と radiance)
+    int guideVertices = 0;
+    int guideCell[MAX_REFLECT];
+    Vec3 guideDir[MAX_REFLECT];
+    double guidePdf[MAX_REFLECT];
+    Vec3 guideThroughput[MAX_REFLECT];
+    Vec3 guideRadiance[MAX_REFLECT];
+  };
 
-    Vec3 throughput(1, 1, 1);
+  // マテリアルの呼び出し。拡散面しかないシーン (F に INTEGRATOR_GLASS がない) では Diffuse を直接呼んでインライン化させる
+  template <int F>
+  inline Vec3 sampleMaterial(Material::BaseMaterial* mat, const Vec3& wo, Vec3& wi, double& pdf, Vec3& uv, Texture& textures) {
+    if constexpr ((F & INTEGRATOR_GLASS) != 0) {
+      return mat->sample(wo, wi, pdf, uv, textures);
+    } else {
+      return static_cast<Material::Diffuse*>(mat)->sampleWith<(F & INTEGRATOR_TEXTURES) != 0>(wo, wi, pdf, uv, textures);
+    }
+  }
 
-    Color result{Vec3(0, 0, 0), 1.0};
-    rayHitMat hitMat = stage.intersectStage(ray.pos.toPoint3(), ray.dir.toVec3());
-    rayHit hit = hitMat.rayhit;
+  template <int F>
+  inline Vec3 evaluateMaterial(Material::BaseMaterial* mat, const Vec3& wo, const Vec3& wi, double& pdf, Vec3& uv, Texture& textures) {
+    if constexpr ((F & INTEGRATOR_GLASS) != 0) {
+      return mat->evaluate(wo, wi, pdf, uv, textures);
+    } else {
+      return static_cast<Material::Diffuse*>(mat)->evaluateWith<(F & INTEGRATOR_TEXTURES) != 0>(wo, wi, pdf, uv, textures);
+    }
+  }
 
+  template <int F>
+  inline Vec3 materialAlbedo(Material::BaseMaterial* mat, Vec3& uv, Texture& textures) {
+    if constexpr ((F & INTEGRATOR_GLASS) != 0) {
+      return mat->albedo(uv, textures);
+    } else {
+      return static_cast<Material::Diffuse*>(mat)->reflectance<(F & INTEGRATOR_TEXTURES) != 0>(uv, textures);
+    }
+  }
+
+  // レイと最も近い交差 h から、経路を1段進める(NEE、次の方向のサンプル、ロシアンルーレット)
+  // F にない機能の分岐はコンパイル時に消える
+  template <int F>
+  inline void shadePath(PathState& path, const stageHit& h, Stage& stage, Texture& textures, PlaneLight& light) {
+    const int i = path.depth;
+    Ray& ray = path.ray;
+    Vec3& throughput = path.throughput;
+    GBufferSample* gbuffer = &path.gbuffer;
+
+    STATS_ADD(cameraRays, i == 0);
+    STATS_ADD(bounceRays, i != 0);
+    rayHitMat hitMat = stage.surfaceInteraction(ray.pos.toPoint3(), ray.dir.toVec3(), h);
+    rayHit hit = hitMat.rayhit;
     if (hit.isHit) {
-        Vec3 point = Vec3(hit.point.x, hit.point.y, hit.point.z);
-        Vec3 normal = normalize(Vec3(hit.normal.x, hit.normal.y, hit.normal.z));
-        Vec3 uv = Vec3(hit.texcoord.x, hit.texcoord.y, 0.0);
-
-        Vec3 rayStart = point;
-        Vec3 s, t;
-        orthonormalBasis(normal, s, t);
-
-        Vec3 wo_local = worldToLocal(-ray.dir, s, normal, t);
+      STATS_ADD(pathVertices, 1);
+      Vec3 point = Vec3(hit.point.x, hit.point.y, hit.point.z);
+      Vec3 normal = Vec3(hit.normal.x, hit.normal.y, hit.normal.z);
+      Vec3 uv = Vec3(hit.texcoord.x, hit.texcoord.y, 0.0);
 
       // material 受け取り
       Material::BaseMaterial *mat = hitMat.mat;
-      // normal
-      result.rgb = s * 0.5 + 0.5;
-      // uv
-      // result.rgb = uv;
-      // texture
-      // result.rgb = textures.get(mat->texId, uv);
-      // isNEE
-      // if(mat->isNEE) {
-      //   result.rgb = Vec3(1.0, 0.0, 0.0);
-      // } else {
-      //   result.rgb = Vec3(0.0, 1.0, 0.0);
-      // }
-
-    } else {
-      result.rgb += throughput * Vec3(0);
-    }
-
-    return result;
-  };
-
-  #else
 
-  Color raytrace(Ray& init_ray, Stage& stage, Texture& textures) {
-    Ray ray = init_ray;
-    ray.pos = init_ray.pos;
-    ray.dir = init_ray.dir;
-
-    Vec3 throughput(1, 1, 1);
+      // NEE をする面か。拡散面しかなければ必ず、NEE をするマテリアルがなければ決してしない
+      const bool nee = (F & INTEGRATOR_NEE) != 0 && ((F & INTEGRATOR_GLASS) == 0 || mat->isNEE);
+
+      // first hit を G-buffer に書き出す
+      if constexpr ((F & INTEGRATOR_AOV) != 0) {
+        if (i == 0) {
+          gbuffer->albedo = materialAlbedo<F>(mat, uv, textures);
+          gbuffer->normal = normal;
+          gbuffer->depth = (point - ray.pos).length();
+          gbuffer->uv = uv;
+          gbuffer->materialId = mat->id;
+          gbuffer->objectId = hitMat.model;
+        }
+        gbuffer->hitCount += 1;
+      }
 
-    PlaneLight light(Vec3(0, 3, 0), 1, Vec3(1.0, 1.0, 1.0) * 10.0);
+      // 拡散面(NEE をする面)では放射輝度キャッシュを引き、学習済みならそこで打ち切る
+      if ((F & INTEGRATOR_LEARNING) != 0 && radianceCache.enabled && nee) {
+        Vec3 facing = dot(normal, ray.dir) > 0 ? -normal : normal;
+        int cell = radianceCache.find(point, facing, true);
+        Vec3 cached;
+        if (i >= radianceCache.minDepth && radianceCache.lookup(cell, cached)) {
+          path.radiance += throughput * cached;
+          path.alive = false;
+          return;
+        }
+        if (cell >= 0) {
+          int k = path.cacheVertices++;
+          path.cacheCell[k] = cell;
+          path.cacheThroughput[k] = throughput;
+          path.cacheRadiance[k] = path.radiance;
+        }
+      }
 
-    Color result{Vec3(0, 0, 0), 1.0};
-    
-    for(int i=0;i<MAX_REFLECT;i++) {
-      rayHitMat hitMat = stage.intersectStage(ray.pos.toPoint3(), ray.dir.toVec3());
-      rayHit hit = hitMat.rayhit;
+      // transform to local cood
+      Vec3 s, t;
+      orthonormalBasis(normal, s, t);
+      Vec3 wo_local = worldToLocal(-ray.dir, s, normal, t);
 
-      if (hit.isHit) {
-        Vec3 point = Vec3(hit.point.x, hit.point.y, hit.point.z);
-        Vec3 normal = Vec3(hit.normal.x, hit.normal.y, hit.normal.z);
-        Vec3 uv = Vec3(hit.texcoord.x, hit.texcoord.y, 0.0);
+      int guideCell = -1;
+      if ((F & INTEGRATOR_LEARNING) != 0 && pathGuide.enabled && nee) {
+        Vec3 facing = dot(normal, ray.dir) > 0 ? -normal : normal;
+        guideCell = pathGuide.find(point, facing, true);
+      }
 
-        // material 受け取り
-        Material::BaseMaterial *mat = hitMat.mat;
+      // reflection calc
+      Vec3 brdf;
+      Vec3 wi_local;
+      Vec3 wi;
+      double pdf;
+      Vec3 neeThroughput;
+      bool absorbed = false;
+      if ((F & INTEGRATOR_LEARNING) != 0 && pathGuide.ready(guideCell)) {
+        // 学習済みのセルでは、ガイドと BSDF のどちらかで方向を選び、混合した pdf で割る
+        Vec3 throughputIn = throughput;
+        if (rnd() < pathGuide.fraction) {
+          wi = pathGuide.sample(guideCell);
+          wi_local = worldToLocal(wi, s, normal, t);
+        } else {
+          sampleMaterial<F>(mat, wo_local, wi_local, pdf, uv, textures);
+          wi = normalize(localToWorld(wi_local, s, normal, t));
+        }
+        double bsdfPdf;
+        brdf = evaluateMaterial<F>(mat, wo_local, wi_local, bsdfPdf, uv, textures);
+        pdf = pathGuide.fraction * pathGuide.pdf(guideCell, wi) + (1 - pathGuide.fraction) * bsdfPdf;
+        absorbed = bsdfPdf <= 0;
+        throughput = absorbed ? Vec3(0) : throughput * brdf * absCosTheta(wi_local) / pdf;
+        // NEE の重みはガイドなしのとき(拡散面では brdf * cos / pdf = 反射率)と同じにする
+        neeThroughput = throughputIn * materialAlbedo<F>(mat, uv, textures);
+      } else {
+        brdf = sampleMaterial<F>(mat, wo_local, wi_local, pdf, uv, textures);
+        double cos = absCosTheta(wi_local);
+        wi = normalize(localToWorld(wi_local, s, normal, t));
+        throughput *= brdf * cos / pdf;
+        neeThroughput = throughput;
+      }
 
-        // transform to local cood
-        Vec3 s, t;
-        orthonormalBasis(normal, s, t);
+      // raystart
+      Vec3 rayStart = point;
 
-        Vec3 wo_local = worldToLocal(-ray.dir, s, normal, t);
+      if (nee) {
+        // NEE
+        Vec3 toLightPos(0);
+        Vec3 toLightDir(0);
+        Vec3 le = light.NEE(point, normal, toLightPos, toLightDir);
 
-        // reflection calc
-        Vec3 brdf;
-        Vec3 wi_local;
-        double pdf;
-        brdf = mat->sample(wo_local, wi_local, pdf, uv, textures);
+        STATS_ADD(shadowRays, 1);
+        // 光源までの間に何かあるかだけ調べればよいので補間はしない
+        double lightDist = (toLightPos - rayStart).length();
+        if (!stage.occludedStage(rayStart.toPoint3(), toLightDir.toVec3(), MINIMUM_INTERSECT_DISTANCE, lightDist)) {
+          path.radiance += le * neeThroughput;
+        }
+      }
 
-        double cos = absCosTheta(wi_local);
+      if ((F & INTEGRATOR_LEARNING) != 0 && guideCell >= 0) {
+        int k = path.guideVertices++;
+        path.guideCell[k] = guideCell;
+        path.guideDir[k] = wi;
+        path.guidePdf[k] = pdf;
+        path.guideThroughput[k] = throughput;
+        path.guideRadiance[k] = path.radiance;
+      }
+      if (absorbed) {
+        // ガイドが面の裏側を選んだ
+        path.alive = false;
+        return;
+      }
 
-        Vec3 wi = normalize(localToWorld(wi_local, s, normal, t));
+      ray = Ray(rayStart, wi);
+    } else {
+      if ((F & INTEGRATOR_AOV) != 0 && i == 0) {
+        gbuffer->albedo = Vec3(1.0);
+      }
+      path.radiance += throughput * Vec3(1.0);
+      path.alive = false;
+      return;
+    }
+    if (rnd() >= ROULETTE) {
+      STATS_ADD(rouletteTerminations, 1);
+      path.alive = false;
+      return;
+    }
+    throughput /= ROULETTE;
+    if (++path.depth >= MAX_REFLECT) {
+      path.alive = false;
+    }
+  }
+
+  // 経路が終わったら、通った拡散面の頂点から先で得た放射輝度でキャッシュを更新する
+  inline void updateRadianceCache(const PathState& path) {
+    for (int k = 0; k < path.cacheVertices; k++) {
+      const Vec3& t = path.cacheThroughput[k];
+      Vec3 L = path.radiance - path.cacheRadiance[k];
+      radianceCache.add(path.cacheCell[k], Vec3(
+        t.x > 0 ? L.x / t.x : 0.0,
+        t.y > 0 ? L.y / t.y : 0.0,
+        t.z > 0 ? L.z / t.z : 0.0));
+    }
+  }
+
+  // 経路が終わったら、ガイドした頂点で選んだ方向から得た放射輝度の明るさを学習する
+  inline void updatePathGuide(const PathState& path) {
+    for (int k = 0; k < path.guideVertices; k++) {
+      const Vec3& t = path.guideThroughput[k];
+      Vec3 L = path.radiance - path.guideRadiance[k];
+      double luminance = ((t.x > 0 ? L.x / t.x : 0.0) + (t.y > 0 ? L.y / t.y : 0.0) + (t.z > 0 ? L.z / t.z : 0.0)) / 3;
+      pathGuide.add(path.guideCell[k], path.guideDir[k], luminance, path.guidePdf[k]);
+    }
+  }
+
+  // 最初の交差 first が分かっている経路を追跡する(ラスタライズした可視性バッファから始めるとき)
+  // F を省略するとどのシーンでも使える全機能の版になる。描画では selectIntegrator で選んだ版を使う
+  template <int F = INTEGRATOR_ALL>
+  Color raytrace(Ray& init_ray, const stageHit& first, Stage& stage, Texture& textures, PlaneLight& light, GBufferSample* gbuffer = nullptr) {
+    PathState path;
+    path.ray = init_ray;
+    STATS_ADD(paths, 1);
+    shadePath<F>(path, first, stage, textures, light);
+    while (path.alive) {
+      stageHit h = stage.intersectStageClosest(path.ray.pos.toPoint3(), path.ray.dir.toVec3());
+      shadePath<F>(path, h, stage, textures, light);
+    }
+    if constexpr ((F & INTEGRATOR_LEARNING) != 0) {
+      updateRadianceCache(path);
+      updatePathGuide(path);
+    }
+    if (gbuffer) {
+      *gbuffer = path.gbuffer;
+    }
+    return Color{path.radiance, 1.0};
+  };
 
-        throughput *= brdf * cos / pdf;
+  template <int F = INTEGRATOR_ALL>
+  Color raytrace(Ray& init_ray, Stage& stage, Texture& textures, PlaneLight& light, GBufferSample* gbuffer = nullptr) {
+    stageHit first = stage.intersectStageClosest(init_ray.pos.toPoint3(), init_ray.dir.toVec3());
+    return raytrace<F>(init_ray, first, stage, textures, light, gbuffer);
+  };
 
-        // raystart
-        Vec3 rayStart = point;
-
-        if (mat->isNEE) {
-          // NEE
-          Vec3 toLightPos(0);
-          Vec3 toLightDir(0);
-          Vec3 le = light.NEE(point, normal, toLightPos, toLightDir);
-
-          rayHit toLightHit = stage.intersectStage(rayStart.toPoint3(), toLightDir.toVec3()).rayhit;
-          Vec3 toLightHitPos = Vec3(toLightHit.point.x, toLightHit.point.y, toLightHit.point.z);
-          double lightDist2 = (toLightPos - rayStart).length2();
-          double hitDist2 = (toLightHitPos - rayStart).length2();
-          if (!toLightHit.isHit || lightDist2 < hitDist2) {
-            result.rgb += le * throughput;
-          }
+  // 10ビットの整数を3ビットおきに広げる(モートン符号用)
+  inline uint32_t expandBits(uint32_t v) {
+    v = (v * 0x00010001u) & 0xFF0000FFu;
+    v = (v * 0x00000101u) & 0x0F00F00Fu;
+    v = (v * 0x00000011u) & 0xC30C30C3u;
+    v = (v * 0x00000005u) & 0x49249249u;
+    return v;
+  }
+
+  // レイを並べるキー。上位3ビットが向きの八分円、下位30ビットが原点のセルのモートン順
+  // 同じキーのレイは同じあたりから同じ向きに飛ぶので、BVHの同じ部分木をたどりやすい
+  inline uint32_t rayKey(const Ray& ray, const Vec3& origin, const Vec3& scale) {
+    auto cell = [](double x) {
+      return (uint32_t)std::max(0.0, std::min(1023.0, x));
+    };
+    uint32_t morton = (expandBits(cell((ray.pos.x - origin.x) * scale.x)) << 2)
+      | (expandBits(cell((ray.pos.y - origin.y) * scale.y)) << 1)
+      | expandBits(cell((ray.pos.z - origin.z) * scale.z));
+    uint32_t octant = (ray.dir.x < 0 ? 1 : 0) | (ray.dir.y < 0 ? 2 : 0) | (ray.dir.z < 0 ? 4 : 0);
+    return (octant << 30) | morton;
+  }
+
+  // paths[0..count) の経路を1段ずつまとめて追跡する
+  // sortRays なら2段目以降(拡散反射でばらばらになったレイ)をキーの順に並べてから交差判定する
+  // firstHits があれば1段目はレイを飛ばさずにそれを使う(ラスタライズした可視性バッファ)
+  // 作業用の配列は scratch から取り、終わったら戻す
+  template <int F = INTEGRATOR_ALL>
+  void traceBatch(PathState* paths, int count, Stage& stage, Texture& textures, PlaneLight& light, bool sortRays, Arena& scratch, const stageHit* firstHits = nullptr) {
+    Arena::Marker marker = scratch.mark();
+    uint64_t* order = scratch.make<uint64_t>(count);
+    stageHit* hits = scratch.make<stageHit>(count);
+
+    STATS_ADD(paths, count);
+    for (int depth = 0; depth < MAX_REFLECT; depth++) {
+      int active = 0;
+      Vec3 lo(INFF), hi(-INFF);
+      for (int k = 0; k < count; k++) {
+        if (!paths[k].alive) continue;
+        order[active++] = k;
+        const Vec3& o = paths[k].ray.pos;
+        lo = Vec3(std::min(lo.x, o.x), std::min(lo.y, o.y), std::min(lo.z, o.z));
+        hi = Vec3(std::max(hi.x, o.x), std::max(hi.y, o.y), std::max(hi.z, o.z));
+      }
+      if (active == 0) break;
+
+      if (sortRays && depth > 0) {
+        auto scaleOf = [](double m, double M) { return M > m ? 1024.0 / (M - m) : 0.0; };
+        Vec3 scale(scaleOf(lo.x, hi.x), scaleOf(lo.y, hi.y), scaleOf(lo.z, hi.z));
+        for (int n = 0; n < active; n++) {
+          uint64_t k = order[n];
+          order[n] = ((uint64_t)rayKey(paths[k].ray, lo, scale) << 32) | k;
         }
+        std::sort(order, order + active);
+      }
 
-
-        ray = Ray(rayStart, wi);
-
-      } else {
-        result.rgb += throughput * Vec3(1.0);
-        break;
+      // 交差判定をまとめて行ってから、同じ順で陰影計算(影のレイを含む)をする
+      for (int n = 0; n < active; n++) {
+        PathState& path = paths[(uint32_t)order[n]];
+        if (depth == 0 && firstHits) {
+          hits[(uint32_t)order[n]] = firstHits[(uint32_t)order[n]];
+          continue;
+        }
+        long long cost = renderStats.traversalCost();
+        hits[(uint32_t)order[n]] = stage.intersectStageClosest(path.ray.pos.toPoint3(), path.ray.dir.toVec3());
+        path.gbuffer.traversalCost += renderStats.traversalCost() - cost;
       }
+      for (int n = 0; n < active; n++) {
+        PathState& path = paths[(uint32_t)order[n]];
+        long long cost = renderStats.traversalCost();
+        shadePath<F>(path, hits[(uint32_t)order[n]], stage, textures, light);
+        path.gbuffer.traversalCost += renderStats.traversalCost() - cost;
+      }
+    }
+    if constexpr ((F & INTEGRATOR_LEARNING) != 0) {
+      for (int k = 0; k < count; k++) {
+        updateRadianceCache(paths[k]);
+        updatePathGuide(paths[k]);
+      }
+    }
 
-      if (rnd() >= ROULETTE) {
-        break;
+    scratch.rewind(marker);
+  }
+
+  // シーンのマテリアルが使う機能 (INTEGRATOR_NEE, INTEGRATOR_TEXTURES, INTEGRATOR_GLASS)
+  // Diffuse 以外のマテリアルがあれば INTEGRATOR_GLASS にして、すべて仮想関数で呼ぶ
+  inline int sceneFeatures(const std::vector<Material::BaseMaterial*>& materials) {
+    int features = 0;
+    for (Material::BaseMaterial* mat : materials) {
+      if (mat->isNEE) features |= INTEGRATOR_NEE;
+      const Material::Diffuse* diffuse = dynamic_cast<const Material::Diffuse*>(mat);
+      if (!diffuse) {
+        features |= INTEGRATOR_GLASS;
+      } else if (diffuse->texId >= 0) {
+        features |= INTEGRATOR_TEXTURES;
       }
-      throughput /= ROULETTE;
+    }
+    return features;
+  }
+
+  // 機能の組み合わせ features に特殊化した積分器
+  // 選んだときより多くの機能を使うシーンで呼んではいけない(マテリアルを変えたら選び直す)
+  struct Integrator {
+    int features = INTEGRATOR_ALL;
+    Color (*traceFrom)(Ray&, const stageHit&, Stage&, Texture&, PlaneLight&, GBufferSample*) = &Raytracer::raytrace<INTEGRATOR_ALL>;
+    void (*traceBatchOf)(PathState*, int, Stage&, Texture&, PlaneLight&, bool, Arena&, const stageHit*) = &Raytracer::traceBatch<INTEGRATOR_ALL>;
+
+    Color raytrace(Ray& ray, const stageHit& first, Stage& stage, Texture& textures, PlaneLight& light, GBufferSample* gbuffer = nullptr) const {
+      return traceFrom(ray, first, stage, textures, light, gbuffer);
+    }
+
+    Color raytrace(Ray& ray, Stage& stage, Texture& textures, PlaneLight& light, GBufferSample* gbuffer = nullptr) const {
+      stageHit first = stage.intersectStageClosest(ray.pos.toPoint3(), ray.dir.toVec3());
+      return traceFrom(ray, first, stage, textures, light, gbuffer);
     }
 
-    return result;
+    void traceBatch(PathState* paths, int count, Stage& stage, Texture& textures, PlaneLight& light, bool sortRays, Arena& scratch, const stageHit* firstHits = nullptr) const {
+      traceBatchOf(paths, count, stage, textures, light, sortRays, scratch, firstHits);
+    }
   };
 
-  #endif
-}
\ No newline at end of file
+  // 全組み合わせの版を並べた表(添字が features)
+  template <int... F>
+  inline const Integrator& integratorTable(int features, std::integer_sequence<int, F...>) {
+    static const Integrator table[] = {Integrator{F, &raytrace<F>, &traceBatch<F>}...};
+    return table[features];
+  }
+
+  // stage を描くのに必要な機能だけを持つ版を選ぶ。aovs なら G-buffer も書く
+  inline Integrator selectIntegrator(Stage& stage, bool aovs) {
+    int features = sceneFeatures(stage.materialList());
+    if (aovs) features |= INTEGRATOR_AOV;
+    if (radianceCache.enabled || pathGuide.enabled) features |= INTEGRATOR_LEARNING;
+    return integratorTable(features, std::make_integer_sequence<int, INTEGRATOR_ALL + 1>());
+  }
+}
@@ -2,6 +2,9 @@
 #define RAYTRACER_TEXTURE_HPP
 
 #include <cmath>
+#include <cstdint>
+#include <vector>
+#include <algorithm>
 #include "vec3.hpp"
 
 #define TEXTURE_SIZE 1024
@@ -12,38 +15,74 @@ namespace Raytracer {
     public:
     Texture() {};
     private:
-      std::vector<int*> textures;
+      // 画素はRGBAを1バイトずつ持つ(JSから渡されるint配列は読み込み後に捨ててよい)
+      struct Image {
+        int size;
+        std::vector<uint8_t> texels;
+      };
+      std::vector<Image> textures;
 
     public:
-      int set(int* texture) {
-        textures.push_back(texture);
+      // TEXTURE_SIZE 四方の texture (RGBA を int で1つずつ) を 2^level 分の1に縮小してコピーする
+      int set(const int* texture, int level = 0) {
+        const int factor = 1 << level;
+        const int size = TEXTURE_SIZE / factor;
+        Image image{size, std::vector<uint8_t>((size_t)size * size * 4)};
+        for (int y = 0; y < size; y++) {
+          for (int x = 0; x < size; x++) {
+            for (int c = 0; c < 4; c++) {
+              int sum = 0;
+              for (int dy = 0; dy < factor; dy++) {
+                for (int dx = 0; dx < factor; dx++) {
+                  sum += texture[((y * factor + dy) * TEXTURE_SIZE + x * factor + dx) * 4 + c];
+                }
+              }
+              image.texels[(y * size + x) * 4 + c] = std::clamp(sum / (factor * factor), 0, 255);
+            }
+          }
+        }
+        textures.push_back(std::move(image));
         return textures.size() - 1;
       }
 
+      // 2^level 分の1に縮小したときのバイト数
+      static size_t bytesOf(int level) {
+        const size_t size = TEXTURE_SIZE >> level;
+        return size * size * 4;
+      }
+
+      size_t bytes() const {
+        size_t sum = 0;
+        for (const Image& image : textures) sum += image.texels.capacity();
+        return sum;
+      }
+
       Vec3 get(int id, Vec3& uv) {
         assert(id < (int)textures.size()/*, "texture id is invalid."*/);
         if (id < 0) return Vec3(1.0);
-        int* texture = textures[id];
+        const Image& image = textures[id];
+        const int size = image.size;
+        const uint8_t* texture = image.texels.data();
 
         double ux = uv.x;
         double uy = uv.y;
-        int fx = std::max(0, (int)std::floor(ux * TEXTURE_SIZE));
-        int fy = std::max(0, (int)std::floor(uy * TEXTURE_SIZE));
-        int cx = std::min((int)std::ceil(ux * TEXTURE_SIZE), TEXTURE_SIZE - 1);
-        int cy = std::min((int)std::ceil(uy * TEXTURE_SIZE), TEXTURE_SIZE - 1);
+        int fx = std::max(0, (int)std::floor(ux * size));
+        int fy = std::max(0, (int)std::floor(uy * size));
+        int cx = std::min((int)std::ceil(ux * size), size - 1);
+        int cy = std::min((int)std::ceil(uy * size), size - 1);
 
-        int ltindex = fy * TEXTURE_SIZE + fx;
-        int lbindex = cy * TEXTURE_SIZE + fx;
-        int rtindex = fy * TEXTURE_SIZE + cx;
-        int rbindex = cy * TEXTURE_SIZE + cx;
+        int ltindex = fy * size + fx;
+        int lbindex = cy * size + fx;
+        int rtindex = fy * size + cx;
+        int rbindex = cy * size + cx;
 
         Vec3 lt((double)texture[ltindex * 4 + 0] / 255.0, (double)texture[ltindex * 4 + 1] / 255.0, (double)texture[ltindex * 4 + 2] / 255.0);
         Vec3 lb((double)texture[lbindex * 4 + 0] / 255.0, (double)texture[lbindex * 4 + 1] / 255.0, (double)texture[lbindex * 4 + 2] / 255.0);
         Vec3 rt((double)texture[rtindex * 4 + 0] / 255.0, (double)texture[rtindex * 4 + 1] / 255.0, (double)texture[rtindex * 4 + 2] / 255.0);
         Vec3 rb((double)texture[rbindex * 4 + 0] / 255.0, (double)texture[rbindex * 4 + 1] / 255.0, (double)texture[rbindex * 4 + 2] / 255.0);
 
-        double dx = ux * TEXTURE_SIZE - fx;
-        double dy = uy * TEXTURE_SIZE - fy;
+        double dx = ux * size - fx;
+        double dy = uy * size - fy;
 
         return lerp(lerp(lt, lb, dy), lerp(rt, rb, dy), dx);
         
@@ -0,0 +1,160 @@
+#ifndef RAYTRACER_TONEMAP_HPP
+#define RAYTRACER_TONEMAP_HPP
+
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+
+//一度に変換する画素数(この分の作業領域をスタックに取る)
+#define TONEMAP_CHUNK 64
+//符号化の表: 2^-TONEMAP_OCTAVES から 1 までを、1段(2倍)ごとに 2^TONEMAP_STEP_BITS 個に分ける
+#define TONEMAP_OCTAVES 18
+#define TONEMAP_STEP_BITS 7
+#define TONEMAP_TABLE_SIZE (TONEMAP_OCTAVES << TONEMAP_STEP_BITS)
+
+namespace Raytracer {
+  // JS側 (src/core/renderer/ToneMapping.ts) と番号を合わせること
+  enum ToneCurve {
+    TONE_CURVE_NONE = 0, // 露出を掛けて 1 で切るだけ
+    TONE_CURVE_ACES = 1, // ACES の近似 (Narkowicz)
+    TONE_CURVE_FILMIC = 2, // Hable のフィルミックカーブ (白を 11.2 とする)
+    TONE_CURVE_COUNT = 3,
+  };
+
+  enum OutputEncoding {
+    OUTPUT_GAMMA_22 = 0, // x^(1/2.2)
+    OUTPUT_SRGB = 1, // sRGB の区分的な変換
+    OUTPUT_ENCODING_COUNT = 2,
+  };
+
+  // 累積バッファを平均した線形の HDR 画像を 8bit の RGBA にする
+  // 露出とトーンカーブは画素ごとに同じ式を並べて計算し(-msimd128 を付ければベクトル化される)、
+  // ガンマの変換は pow を呼ばずに、float のビット(指数と仮数の上位)で引いた表から値を求める
+  // HDR 画像を取っておけば、設定を変えても描き直さずにすぐ変換し直せる
+  struct ToneMapper {
+    float exposure = 0; // 段 (EV)。明るさを 2^exposure 倍する
+    int curve = TONE_CURVE_NONE;
+    int encoding = OUTPUT_GAMMA_22;
+    bool dither = false; // 量子化の誤差を 8x8 のベイヤー行列で散らす(乱数は使わない)
+    double start[257]; // 値 c になり始めるトーンカーブ後の線形の値 (start[0] は使わない、start[256] は無限大)
+    uint8_t table[TONEMAP_TABLE_SIZE]; // 表の区間の始まりの値。区間の中では高々2つしか増えない
+
+    ToneMapper() {
+      configure(0, TONE_CURVE_NONE, OUTPUT_GAMMA_22, false);
+    }
+
+    void configure(float _exposure, int _curve, int _encoding, bool _dither) {
+      exposure = _exposure;
+      curve = _curve;
+      encoding = _encoding;
+      dither = _dither;
+      for (int c = 0; c < 256; c++) {
+        start[c] = decode(c / 255.0);
+      }
+      start[256] = INFINITY;
+      for (int k = 0; k < TONEMAP_TABLE_SIZE; k++) {
+        uint32_t bits = lowestBits() + ((uint32_t)k << (23 - TONEMAP_STEP_BITS));
+        float x;
+        std::memcpy(&x, &bits, sizeof(float));
+        int c = 0;
+        for (int step = 128; step > 0; step >>= 1) {
+          c += (double)x >= start[c + step] ? step : 0;
+        }
+        table[k] = c;
+      }
+    }
+
+    // 表の最初の区間の始まり 2^-TONEMAP_OCTAVES の float のビット
+    static uint32_t lowestBits() {
+      return (uint32_t)(127 - TONEMAP_OCTAVES) << 23;
+    }
+
+    // 8bit に符号化した値 v (0..1) に対応する線形の値
+    double decode(double v) const {
+      if (encoding == OUTPUT_SRGB) {
+        return v <= 0.04045 ? v / 12.92 : std::pow((v + 0.055) / 1.055, 2.4);
+      }
+      return std::pow(v, 2.2);
+    }
+
+    static float hable(float x) {
+      const float A = 0.15f, B = 0.50f, C = 0.10f, D = 0.20f, E = 0.02f, F = 0.30f;
+      return ((x * (A * x + C * B) + D * E) / (x * (A * x + B) + D * F)) - E / F;
+    }
+
+    // 露出とトーンカーブ。v は count 個の値(チャンネルは問わない)
+    void applyCurve(float* v, int count) const {
+      const float scale = std::exp2(exposure);
+      if (curve == TONE_CURVE_ACES) {
+        for (int k = 0; k < count; k++) {
+          float x = v[k] * scale;
+          v[k] = (x * (2.51f * x + 0.03f)) / (x * (2.43f * x + 0.59f) + 0.14f);
+        }
+      } else if (curve == TONE_CURVE_FILMIC) {
+        const float white = 1.0f / hable(11.2f);
+        for (int k = 0; k < count; k++) {
+          v[k] = hable(v[k] * scale) * white;
+        }
+      } else {
+        for (int k = 0; k < count; k++) {
+          v[k] *= scale;
+        }
+      }
+    }
+
+    // トーンカーブ後の線形の値 x を 8bit にする。threshold (0..1) は誤差を散らすしきい値
+    // しきい値を double で持って x を double にして比べるので、0..1 のすべての float で
+    // 切り捨てで x^(1/2.2) * 255 を整数にしたのと同じ値になる(float のしきい値では境目の近くで1つずれていた)
+    // ditherなら隣の値との間を線形の値で按分して選ぶ
+    int encode(float x, float threshold) const {
+      x = std::min(x > 0 ? x : 0.0f, 1.0f); // NaN も 0 にする
+      uint32_t bits;
+      std::memcpy(&bits, &x, sizeof(float));
+      uint32_t k = (std::max(bits, lowestBits()) - lowestBits()) >> (23 - TONEMAP_STEP_BITS);
+      int c = table[std::min(k, (uint32_t)TONEMAP_TABLE_SIZE - 1)];
+      const double xd = x;
+      c += xd >= start[c + 1] ? 1 : 0;
+      c += xd >= start[c + 1] ? 1 : 0;
+      if (dither && c < 255) {
+        float frac = (float)((xd - start[c]) / (start[c + 1] - start[c]));
+        c += frac > threshold ? 1 : 0;
+      }
+      return c;
+    }
+
+    // width*height の線形 RGB (画素あたり3つの float) を RGBA の int に変換して out に書く
+    void apply(const float* rgb, int width, int height, int* out) const {
+      static const uint8_t bayer[64] = {
+         0, 32,  8, 40,  2, 34, 10, 42,
+        48, 16, 56, 24, 50, 18, 58, 26,
+        12, 44,  4, 36, 14, 46,  6, 38,
+        60, 28, 52, 20, 62, 30, 54, 22,
+         3, 35, 11, 43,  1, 33,  9, 41,
+        51, 19, 59, 27, 49, 17, 57, 25,
+        15, 47,  7, 39, 13, 45,  5, 37,
+        63, 31, 55, 23, 61, 29, 53, 21,
+      };
+      float v[TONEMAP_CHUNK * 3];
+      for (int j = 0; j < height; j++) {
+        for (int i0 = 0; i0 < width; i0 += TONEMAP_CHUNK) {
+          const int n = std::min(TONEMAP_CHUNK, width - i0);
+          const int index0 = j * width + i0;
+          std::copy(rgb + index0 * 3, rgb + (index0 + n) * 3, v);
+          applyCurve(v, n * 3);
+          for (int k = 0; k < n; k++) {
+            const int i = i0 + k;
+            const float threshold = (bayer[(j & 7) * 8 + (i & 7)] + 0.5f) / 64;
+            int* p = out + (index0 + k) * 4;
+            p[0] = encode(v[k * 3 + 0], threshold);
+            p[1] = encode(v[k * 3 + 1], threshold);
+            p[2] = encode(v[k * 3 + 2], threshold);
+            p[3] = 255;
+          }
+        }
+      }
+    }
+  };
+}
+
+#endif
@@ -43,6 +43,25 @@ struct rayHit{
     texpoint texcoord;
 };
 
+//三角形との交差判定の結果(補間前)
+//u,vはそれぞれ2,3番目の頂点の重心座標、primは三角形の番号
+struct triHit{
+    bool isHit;
+    double t;
+    double u;
+    double v;
+    int prim;
+};
+
+//交差判定の前に1回だけ計算しておくrayの情報
+struct rayQuery{
+    point3 o;
+    vec3 d;
+    vec3 invd; //箱との判定用の逆数
+    int kx,ky,kz; //kzがdの絶対値最大の軸
+    double Sx,Sy,Sz; //rayをz軸に揃えるシアー変換の係数
+};
+
 //3次元正方行列[a,b,c]の行列式をSarrusの方法で求める
 //TODO:誤差にやさしい形式で実装したい
 double determinant(vec3 a, vec3 b, vec3 c){
@@ -114,6 +133,90 @@ rayHit intersectTriangle(point3 o,vec3 d,tri3 T){
     };
 }
 
+double axisOf(const point3& p,int k){
+    return k==0 ? p.x : (k==1 ? p.y : p.z);
+}
+
+double axisOf(const vec3& v,int k){
+    return k==0 ? v.x : (k==1 ? v.y : v.z);
+}
+
+rayQuery prepareRay(point3 o,vec3 d){
+    rayQuery r;
+    r.o = o;
+    r.d = d;
+    r.invd = {1.0/d.x,1.0/d.y,1.0/d.z};
+
+    r.kz = 0;
+    if(std::abs(d.y) > std::abs(axisOf(d,r.kz)))r.kz = 1;
+    if(std::abs(d.z) > std::abs(axisOf(d,r.kz)))r.kz = 2;
+    r.kx = (r.kz+1)%3;
+    r.ky = (r.kx+1)%3;
+    //向きを保つために入れ替える
+    if(axisOf(d,r.kz) < 0)std::swap(r.kx,r.ky);
+
+    r.Sx = axisOf(d,r.kx)/axisOf(d,r.kz);
+    r.Sy = axisOf(d,r.ky)/axisOf(d,r.kz);
+    r.Sz = 1.0/axisOf(d,r.kz);
+    return r;
+}
+
+//Watertight Ray/Triangle Intersection (Woop et al. 2013)
+//辺の上に当たったrayが隣り合う三角形の両方で外れることがない
+//(tMin,tMax)の範囲の交差だけを返す
+triHit intersectTriangleWatertight(const rayQuery& r,const point3& v0,const point3& v1,const point3& v2,double tMin,double tMax){
+    const triHit miss = {false,INFF,-1,-1,-1};
+
+    vec3 A = {v0.x-r.o.x,v0.y-r.o.y,v0.z-r.o.z};
+    vec3 B = {v1.x-r.o.x,v1.y-r.o.y,v1.z-r.o.z};
+    vec3 C = {v2.x-r.o.x,v2.y-r.o.y,v2.z-r.o.z};
+
+    const double Az = axisOf(A,r.kz),Bz = axisOf(B,r.kz),Cz = axisOf(C,r.kz);
+    const double Ax = axisOf(A,r.kx)-r.Sx*Az, Ay = axisOf(A,r.ky)-r.Sy*Az;
+    const double Bx = axisOf(B,r.kx)-r.Sx*Bz, By = axisOf(B,r.ky)-r.Sy*Bz;
+    const double Cx = axisOf(C,r.kx)-r.Sx*Cz, Cy = axisOf(C,r.ky)-r.Sy*Cz;
+
+    const double U = Cx*By-Cy*Bx;
+    const double V = Ax*Cy-Ay*Cx;
+    const double W = Bx*Ay-By*Ax;
+
+    if((U<0 || V<0 || W<0) && (U>0 || V>0 || W>0)){
+        return miss;
+    }
+
+    const double det = U+V+W;
+    if(det==0.0){
+        return miss;
+    }
+
+    const double T = r.Sz*(U*Az+V*Bz+W*Cz);
+    const double rcpDet = 1.0/det;
+    const double t = T*rcpDet;
+    if(!(t > tMin && t < tMax)){
+        return miss;
+    }
+
+    return {true,t,V*rcpDet,W*rcpDet,-1};
+}
+
+//rayと直方体(p,qが対角線上の2頂点、p<=q)が[tMin,tMax]の範囲で交わるかを判定し、交わるなら入るときのtをtEnterに入れる
+bool intersectBoxInterval(const rayQuery& r,const point3& p,const point3& q,double tMin,double tMax,double& tEnter){
+    double t1 = (p.x-r.o.x)*r.invd.x, t2 = (q.x-r.o.x)*r.invd.x;
+    tMin = std::max(tMin,std::min(t1,t2));
+    tMax = std::min(tMax,std::max(t1,t2));
+
+    t1 = (p.y-r.o.y)*r.invd.y, t2 = (q.y-r.o.y)*r.invd.y;
+    tMin = std::max(tMin,std::min(t1,t2));
+    tMax = std::min(tMax,std::max(t1,t2));
+
+    t1 = (p.z-r.o.z)*r.invd.z, t2 = (q.z-r.o.z)*r.invd.z;
+    tMin = std::max(tMin,std::min(t1,t2));
+    tMax = std::min(tMax,std::max(t1,t2));
+
+    tEnter = tMin;
+    return tMin <= tMax;
+}
+
 //rayの始点oと向きd、p,qを対角線上にもつ直方体Bを与えると、Bの内部(または境界)にrayが
 //当たるかを判定し、当たらないならfalseを、当たるならtrueとそのポイントを返す
 std::pair<bool,point3> intersectBox(point3 o,vec3 d,point3 p,point3 q){
@@ -1,16 +1,30 @@
+#include <memory>
+#include <set>
 #include "BVH.hpp"
 #include "raytracer/material.hpp"
 
 struct Models{
-    ModelBVH bvh;
+    std::shared_ptr<ModelBVH> bvh; //インスタンス同士で共有する
     std::array<double,16> dir;
     std::array<double,16> dirinv;
     Raytracer::Material::BaseMaterial *mat;
 };
 
+//ステージとの交差判定の結果(補間前)
+//modelは当たったモデルの番号、primはそのモデル内の三角形番号
+struct stageHit{
+    bool isHit;
+    double t;
+    double u;
+    double v;
+    int prim;
+    int model;
+};
+
 struct rayHitMat{
     rayHit rayhit;
     Raytracer::Material::BaseMaterial *mat;
+    int model;
 };
 
 //複数のモデルとレイの当たり判定をする関数のクラス
@@ -19,6 +33,9 @@ class Stage{
     private:
     std::vector<Models> models;
     std::vector<bool> active;
+    std::vector<Raytracer::Material::BaseMaterial*> materials;
+    int nodeBits = 0; //BVHのノードを量子化するビット数(0なら圧縮しない)
+    double splitBudget = 0; //SBVHで増やしてよい三角形の参照の割合(0なら空間分割しない)
 
     public:
     /*void construct(void){
@@ -27,21 +44,132 @@ class Stage{
     }*/
 
     //頂点情報をv、ポリゴン情報をp、テクスチャ情報をt、モデルの回転拡大平行移動をd(の逆行列)としてステージに追加し、インデックスを返す
+    //v,pはムーブで渡せばコピーされない
     int add(std::vector<vert> v,std::vector<std::array<int,3>> p,std::array<double,16> d,std::array<double,16> di,Raytracer::Material::BaseMaterial *m){
         int n = models.size();
         
-        ModelBVH bvh;
-        bvh.construct(v,p);
+        models.push_back({std::make_shared<ModelBVH>(),d,di,m});
+        models.back().bvh->construct(std::move(v),std::move(p),splitBudget);
+        if(nodeBits!=0)models.back().bvh->compress(nodeBits);
 
-        Models newModel = {bvh,d,di,m};
-        models.push_back(newModel);
-        
-        active.resize(n+1);
-        active[n] = true;
+        registerModel(n,m);
+        return n;
+    }
+
+    //source番目のモデルと形状(BVH)を共有するインスタンスを、別の変換d(の逆行列)とマテリアルで追加する
+    int addInstance(int source,std::array<double,16> d,std::array<double,16> di,Raytracer::Material::BaseMaterial *m){
+        int n = models.size();
+        models.push_back({models[source].bvh,d,di,m});
 
+        registerModel(n,m);
         return n;
     }
 
+    int size(){
+        return models.size();
+    }
+
+    //index番目のモデルのポリゴン数
+    int modelTriangleCount(int index){
+        return models[index].bvh->triangleCount();
+    }
+
+    //index番目のモデルの変換をd(の逆行列di)に置き換える。BVHはモデル座標なので作り直さない
+    void setTransform(int index,std::array<double,16> d,std::array<double,16> di){
+        models[index].dir = d;
+        models[index].dirinv = di;
+    }
+
+    //index番目のモデルのマテリアルをmに置き換える
+    void setMaterial(int index,Raytracer::Material::BaseMaterial *m){
+        models[index].mat = m;
+        registerMaterial(m);
+    }
+
+    //BVHのノードをbits(0,8,16)ビットに量子化する。今あるモデルもこれから追加するモデルも対象
+    //一度圧縮したモデルは別の形式に戻せないので、変換できないモデルが1つでもあれば何も変えずにfalseを返す
+    bool setNodeCompression(int bits){
+        if(bits!=0 && bits!=8 && bits!=16)return false;
+        for(const auto& m : models){
+            int current = m.bvh->compressionBits();
+            if(current!=bits && current!=0)return false;
+        }
+        for(auto& m : models){
+            if(!m.bvh->compress(bits))return false;
+        }
+        nodeBits = bits;
+        return true;
+    }
+
+    //これから追加するモデルを空間分割ありのSBVHで構築する
+    //budgetはポリゴン数に対して増やしてよい参照の割合(0.3なら3割まで)
+    void setSpatialSplits(double budget){
+        splitBudget = std::max(0.0,budget);
+    }
+
+    //これから追加するモデルに必要なバイト数の見積もり
+    size_t estimateBytes(int vertexCount,int triangleCount){
+        return ModelBVH::estimateBytes(vertexCount,triangleCount,splitBudget);
+    }
+
+    int compressionBits(){
+        return nodeBits;
+    }
+
+    //登録したマテリアル(置き換えて使われなくなったものも含む)
+    const std::vector<Raytracer::Material::BaseMaterial*>& materialList(){
+        return materials;
+    }
+
+    //インスタンスで共有しているBVHは1回だけ数える
+    size_t nodeBytes(){
+        size_t sum = 0;
+        for(ModelBVH* b : uniqueBVH())sum += b->nodeBytes();
+        return sum;
+    }
+
+    size_t geometryBytes(){
+        size_t sum = 0;
+        for(ModelBVH* b : uniqueBVH())sum += b->geometryBytes();
+        return sum;
+    }
+
+    long long triangleCount(){
+        long long sum = 0;
+        for(ModelBVH* b : uniqueBVH())sum += b->triangleCount();
+        return sum;
+    }
+
+    long long referenceCount(){
+        long long sum = 0;
+        for(ModelBVH* b : uniqueBVH())sum += b->referenceCount();
+        return sum;
+    }
+
+    private:
+    std::set<ModelBVH*> uniqueBVH(){
+        std::set<ModelBVH*> s;
+        for(auto& m : models)s.insert(m.bvh.get());
+        return s;
+    }
+
+    //マテリアルIDは異なるマテリアルごとに振る
+    void registerMaterial(Raytracer::Material::BaseMaterial *m){
+        if(std::find(materials.begin(),materials.end(),m)==materials.end()){
+            m->id = materials.size();
+            materials.push_back(m);
+        }
+    }
+
+    void registerModel(int n,Raytracer::Material::BaseMaterial *m){
+        registerMaterial(m);
+
+        active.resize(n+1);
+        active[n] = true;
+    }
+
+    public:
+
     //与えられたインデックスのモデルの当たり判定を無効にする
     void deactivate(int index){
         active[index] = false;
@@ -52,11 +180,10 @@ class Stage{
         active[index] = true;
     }
 
-    //与えられた光線とモデルたちの当たり判定をする
-    rayHitMat intersectStage(point3 o,vec3 d){
-        rayHit retr = {false,{INFF,INFF,INFF},-1,{0,0,0},-1,-1,{INFF,INFF}};
-        rayHitMat ret = {retr,models[0].mat};
-        double length = INFF;
+    //与えられた光線とモデルたちの当たり判定をし、[tMin,tMax]の範囲で最も近い交差のt,u,vと番号だけを返す
+    //dはワールド座標で正規化されていること(tがそのまま距離になる)
+    stageHit intersectStageClosest(point3 o,vec3 d,double tMin = MINIMUM_INTERSECT_DISTANCE,double tMax = INFF){
+        stageHit ret = {false,tMax,-1,-1,-1,-1};
 
         for(int i=0;i<(int)models.size();i++){
             if(!active[i])continue;
@@ -67,43 +194,112 @@ class Stage{
                 models[i].dirinv[2]*o.x + models[i].dirinv[6]*o.y + models[i].dirinv[10]*o.z + models[i].dirinv[14],
             };
 
+            //正規化しないことで、モデル座標でのtがワールド座標でのtと一致する
             vec3 dt = {
                 models[i].dirinv[0]*d.x + models[i].dirinv[4]*d.y + models[i].dirinv[8]*d.z,
                 models[i].dirinv[1]*d.x + models[i].dirinv[5]*d.y + models[i].dirinv[9]*d.z,
                 models[i].dirinv[2]*d.x + models[i].dirinv[6]*d.y + models[i].dirinv[10]*d.z,
             };
 
-            dt = normalize(dt);
-            rayHit r = models[i].bvh.intersectModel(ot,dt);
-
-            if(!r.isHit)continue;
-            double dx = r.point.x-ot.x,dy = r.point.y-ot.y,dz = r.point.z-ot.z;
-            double rleng = sqrt(dx*dx+dy*dy+dz*dz);
-            if(!ret.rayhit.isHit || rleng < length){
-                ret.rayhit = {
-                    r.isHit,
-                    {
-                        models[i].dir[0]*r.point.x + models[i].dir[4]*r.point.y + models[i].dir[8]*r.point.z + models[i].dir[12],
-                        models[i].dir[1]*r.point.x + models[i].dir[5]*r.point.y + models[i].dir[9]*r.point.z + models[i].dir[13],
-                        models[i].dir[2]*r.point.x + models[i].dir[6]*r.point.y + models[i].dir[10]*r.point.z + models[i].dir[14],
-                    },
-                    r.index,
-                    normalize({
-                        models[i].dir[0]*r.normal.x + models[i].dir[4]*r.normal.y + models[i].dir[8]*r.normal.z,
-                        models[i].dir[1]*r.normal.x + models[i].dir[5]*r.normal.y + models[i].dir[9]*r.normal.z,
-                        models[i].dir[2]*r.normal.x + models[i].dir[6]*r.normal.y + models[i].dir[10]*r.normal.z,
-                    }),
-                    r.u,
-                    r.v,
-                    r.texcoord
-                };
-                ret.mat = models[i].mat;
-                length = rleng;
+            triHit r = models[i].bvh->intersectModelClosest(ot,dt,tMin,ret.t);
+            if(r.isHit){
+                ret = {true,r.t,r.u,r.v,r.prim,i};
             }
-
         }
 
         return ret;
     }
 
+    //[tMin,tMax]の範囲に何か当たるものがあるかだけを調べる(影のレイ用)
+    //どれか1つのモデルで当たった時点で終わる
+    bool occludedStage(point3 o,vec3 d,double tMin = MINIMUM_INTERSECT_DISTANCE,double tMax = INFF){
+        for(int i=0;i<(int)models.size();i++){
+            if(!active[i])continue;
+
+            point3 ot = {
+                models[i].dirinv[0]*o.x + models[i].dirinv[4]*o.y + models[i].dirinv[8]*o.z + models[i].dirinv[12],
+                models[i].dirinv[1]*o.x + models[i].dirinv[5]*o.y + models[i].dirinv[9]*o.z + models[i].dirinv[13],
+                models[i].dirinv[2]*o.x + models[i].dirinv[6]*o.y + models[i].dirinv[10]*o.z + models[i].dirinv[14],
+            };
+            vec3 dt = {
+                models[i].dirinv[0]*d.x + models[i].dirinv[4]*d.y + models[i].dirinv[8]*d.z,
+                models[i].dirinv[1]*d.x + models[i].dirinv[5]*d.y + models[i].dirinv[9]*d.z,
+                models[i].dirinv[2]*d.x + models[i].dirinv[6]*d.y + models[i].dirinv[10]*d.z,
+            };
+
+            if(models[i].bvh->intersectModelClosest(ot,dt,tMin,tMax,true).isHit)return true;
+        }
+        return false;
+    }
+
+    //モデルmodelのモデル座標の点pをワールド座標に変換する
+    point3 pointToWorld(int model,point3 p){
+        const std::array<double,16>& m = models[model].dir;
+        return {
+            m[0]*p.x + m[4]*p.y + m[8]*p.z + m[12],
+            m[1]*p.x + m[5]*p.y + m[9]*p.z + m[13],
+            m[2]*p.x + m[6]*p.y + m[10]*p.z + m[14],
+        };
+    }
+
+    //モデルmodelのモデル座標の法線nをワールド座標に変換する(逆行列の転置をかけて正規化)
+    vec3 normalToWorld(int model,vec3 n){
+        const std::array<double,16>& m = models[model].dirinv;
+        return normalize(vec3{
+            m[0]*n.x + m[1]*n.y + m[2]*n.z,
+            m[4]*n.x + m[5]*n.y + m[6]*n.z,
+            m[8]*n.x + m[9]*n.y + m[10]*n.z,
+        });
+    }
+
+    //有効なモデルの三角形ごとにf(モデル番号,三角形番号,頂点0,頂点1,頂点2)を呼ぶ(ワールド座標)
+    //ラスタライズのように、BVHを使わずに全ての三角形を見るときに使う
+    template<typename F>
+    void forEachTriangle(F f){
+        for(int i=0;i<(int)models.size();i++){
+            if(!active[i])continue;
+            models[i].bvh->forEachTriangle([&](int prim,const point3& a,const point3& b,const point3& c){
+                f(i,prim,pointToWorld(i,a),pointToWorld(i,b),pointToWorld(i,c));
+            });
+        }
+    }
+
+    //モデルmodelの三角形番号prim(葉の順)の元のポリゴン番号
+    int polygonOf(int model,int prim){
+        return models[model].bvh->polygonOf(prim);
+    }
+
+    //最も近い交差が決まってから、1回だけ座標・法線・テクスチャ座標とマテリアルを求める
+    rayHitMat surfaceInteraction(point3 o,vec3 d,const stageHit& h){
+        rayHit retr = {false,{INFF,INFF,INFF},-1,{0,0,0},-1,-1,{INFF,INFF}};
+        if(!h.isHit){
+            return {retr,models.empty() ? nullptr : models[0].mat,-1};
+        }
+
+        const Models& m = models[h.model];
+        vec3 n;
+        texpoint tex;
+        m.bvh->attributes(h.prim,h.u,h.v,n,tex);
+
+        retr = {
+            true,
+            {o.x+h.t*d.x, o.y+h.t*d.y, o.z+h.t*d.z},
+            m.bvh->polygonOf(h.prim),
+            normalize({
+                m.dir[0]*n.x + m.dir[4]*n.y + m.dir[8]*n.z,
+                m.dir[1]*n.x + m.dir[5]*n.y + m.dir[9]*n.z,
+                m.dir[2]*n.x + m.dir[6]*n.y + m.dir[10]*n.z,
+            }),
+            h.u,
+            h.v,
+            tex
+        };
+        return {retr,m.mat,h.model};
+    }
+
+    //与えられた光線とモデルたちの当たり判定をする
+    rayHitMat intersectStage(point3 o,vec3 d){
+        return surfaceInteraction(o,d,intersectStageClosest(o,d));
+    }
+
 };
\ No newline at end of file
@@ -0,0 +1,95 @@
+#ifndef STATS_HPP
+#define STATS_HPP
+
+#include <string>
+#include <vector>
+
+//レンダリング統計を取るときは有効にする(make build FLAGS=-DRAYTRACER_STATS でも可)
+//無効のときは STATS_ADD が消えるのでホットパスにコストはかからない
+// #define RAYTRACER_STATS
+
+#ifdef RAYTRACER_STATS
+#include <chrono>
+#endif
+
+//1フレーム分のレンダリング統計
+struct RenderStats{
+    long long cameraRays = 0;
+    long long bounceRays = 0;
+    long long shadowRays = 0;
+    long long nodeVisits = 0;
+    long long triangleTests = 0;
+    long long paths = 0;
+    long long pathVertices = 0;
+    long long rouletteTerminations = 0;
+
+    //シーンのメモリ(統計の有効無効に関係なくpathTracerで記録する)
+    long long triangles = 0;
+    long long references = 0; //SBVHで複製された三角形を含む
+    long long geometryBytes = 0;
+    long long bvhNodeBytes = 0;
+    int bvhNodeBits = 0;
+
+    //readStream 1回分(タイル)ごとの処理時間
+    struct Tile{
+        int x, y, width, height;
+        double ms;
+    };
+    std::vector<Tile> tiles;
+
+    void reset(){
+        *this = RenderStats();
+    }
+
+    //走査コスト(ヒートマップ用)
+    long long traversalCost() const {
+        return nodeVisits + triangleTests;
+    }
+
+    std::string toJSON() const {
+        std::string s = "{";
+#ifdef RAYTRACER_STATS
+        s += "\"enabled\":true";
+#else
+        s += "\"enabled\":false";
+#endif
+        s += ",\"rays\":{\"camera\":" + std::to_string(cameraRays)
+            + ",\"bounce\":" + std::to_string(bounceRays)
+            + ",\"shadow\":" + std::to_string(shadowRays) + "}";
+        s += ",\"nodeVisits\":" + std::to_string(nodeVisits);
+        s += ",\"triangleTests\":" + std::to_string(triangleTests);
+        s += ",\"paths\":" + std::to_string(paths);
+        s += ",\"averagePathLength\":" + std::to_string(paths > 0 ? (double)pathVertices / paths : 0.0);
+        s += ",\"rouletteTerminations\":" + std::to_string(rouletteTerminations);
+        s += ",\"scene\":{\"triangles\":" + std::to_string(triangles)
+            + ",\"references\":" + std::to_string(references)
+            + ",\"geometryBytes\":" + std::to_string(geometryBytes)
+            + ",\"bvhNodeBytes\":" + std::to_string(bvhNodeBytes)
+            + ",\"bvhNodeBits\":" + std::to_string(bvhNodeBits) + "}";
+        s += ",\"tiles\":[";
+        for(int i=0;i<(int)tiles.size();i++){
+            if(i>0)s += ",";
+            s += "{\"x\":" + std::to_string(tiles[i].x)
+                + ",\"y\":" + std::to_string(tiles[i].y)
+                + ",\"width\":" + std::to_string(tiles[i].width)
+                + ",\"height\":" + std::to_string(tiles[i].height)
+                + ",\"ms\":" + std::to_string(tiles[i].ms) + "}";
+        }
+        s += "]}";
+        return s;
+    }
+};
+
+RenderStats renderStats;
+
+#ifdef RAYTRACER_STATS
+#define STATS_ADD(field, n) (renderStats.field += (n))
+#define STATS_TIMER_START(name) auto name = std::chrono::steady_clock::now()
+#define STATS_TIMER_MS(name) std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - name).count()
+#else
+#define STATS_ADD(field, n) ((void)0)
+#define STATS_TIMER_START(name) ((void)0)
+#define STATS_TIMER_MS(name) 0.0
+#endif
+
+#endif
@@ -0,0 +1,53 @@
+#ifndef TILE_HPP
+#define TILE_HPP
+
+#include <vector>
+#include <algorithm>
+
+#define TILE_SIZE 16
+//サンプルを交互に回す近傍の画素数(モートン順で連続する4画素は2x2の四角になる)
+#define PIXEL_GROUP 4
+
+//画面を分割した矩形領域
+struct Tile{
+    int x, y, width, height;
+};
+
+//width*heightの画面をsize四方のタイルに分割する(端は小さくなる)
+std::vector<Tile> makeTiles(int width, int height, int size = TILE_SIZE){
+    std::vector<Tile> tiles;
+    for(int y = 0; y < height; y += size){
+        for(int x = 0; x < width; x += size){
+            tiles.push_back({x, y, std::min(size, width - x), std::min(size, height - y)});
+        }
+    }
+    return tiles;
+}
+
+//16ビットの整数を1ビットおきに広げる
+inline unsigned int spreadBits(unsigned int v){
+    v &= 0xFFFF;
+    v = (v | (v << 8)) & 0x00FF00FF;
+    v = (v | (v << 4)) & 0x0F0F0F0F;
+    v = (v | (v << 2)) & 0x33333333;
+    v = (v | (v << 1)) & 0x55555555;
+    return v;
+}
+
+//width*heightのタイル内の画素(行優先の番号)をモートン順(Z字)に並べる
+//続けて描く画素が近くなるので、カメラレイがBVHの同じノードやテクスチャの同じ場所をたどりやすい
+std::vector<int> mortonOrder(int width, int height){
+    std::vector<std::pair<unsigned int, int>> keys;
+    keys.reserve(width * height);
+    for(int y = 0; y < height; y++){
+        for(int x = 0; x < width; x++){
+            keys.push_back({spreadBits(x) | (spreadBits(y) << 1), y * width + x});
+        }
+    }
+    std::sort(keys.begin(), keys.end());
+    std::vector<int> order(keys.size());
+    for(int i = 0; i < (int)keys.size(); i++) order[i] = keys[i].second;
+    return order;
+}
+
+#endif